@@ -0,0 +1,97 @@
+#include "Animation.h"
+#include <glm/gtc/matrix_transform.hpp>
+#include <algorithm>
+#include <cmath>
+
+AnimationSampler::AnimationSampler(const std::vector<SkeletonNode>& nodes, const std::vector<Bone>& bones,
+	const std::vector<AnimationClip>& clips)
+	:nodes(&nodes), bones(&bones), clips(&clips)
+{
+	for (auto& clip : clips)
+	{
+		std::vector<int> channels(nodes.size(), -1);
+		for (int c = 0; c < (int)clip.channels.size(); c++)
+			channels[clip.channels[c].node] = c;
+		node_channels.push_back(std::move(channels));
+	}
+	globals.resize(nodes.size());
+	bone_palette.assign(bones.size(), glm::mat4(1.0f));
+	if (!nodes.empty())
+		global_inverse = glm::inverse(nodes[0].transform);
+}
+
+// index of the last key at or before time, keys are sorted by time
+template<typename Key>
+static size_t keyBefore(const std::vector<Key>& keys, float time)
+{
+	auto next = std::upper_bound(keys.begin(), keys.end(), time,
+		[](float t, const Key& key) { return t < key.time; });
+	return next == keys.begin() ? 0 : (size_t)(next - keys.begin()) - 1;
+}
+
+template<typename Key>
+static float keyFactor(const std::vector<Key>& keys, size_t i, float time)
+{
+	float span = keys[i + 1].time - keys[i].time;
+	return span > 0.0f ? std::clamp((time - keys[i].time) / span, 0.0f, 1.0f) : 0.0f;
+}
+
+static glm::vec3 sampleVector(const std::vector<VectorKey>& keys, float time, const glm::vec3& fallback)
+{
+	if (keys.empty())
+		return fallback;
+	size_t i = keyBefore(keys, time);
+	if (i + 1 >= keys.size())
+		return keys[i].value;
+	return glm::mix(keys[i].value, keys[i + 1].value, keyFactor(keys, i, time));
+}
+
+static glm::quat sampleQuat(const std::vector<QuatKey>& keys, float time)
+{
+	if (keys.empty())
+		return glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
+	size_t i = keyBefore(keys, time);
+	if (i + 1 >= keys.size())
+		return keys[i].value;
+	return glm::normalize(glm::slerp(keys[i].value, keys[i + 1].value, keyFactor(keys, i, time)));
+}
+
+void AnimationSampler::evaluate(unsigned int clip, float seconds)
+{
+	if (!nodes || clip >= clips->size())
+		return;
+
+	const AnimationClip& animation = (*clips)[clip];
+	const std::vector<int>& channels = node_channels[clip];
+	float ticks = seconds * animation.ticksPerSecond;
+	float time = animation.duration > 0.0f ? std::fmod(ticks, animation.duration) : 0.0f;
+
+	for (size_t n = 0; n < nodes->size(); n++)
+	{
+		const SkeletonNode& node = (*nodes)[n];
+		glm::mat4 local = node.transform;
+		if (channels[n] >= 0)
+		{
+			const NodeAnimation& channel = animation.channels[channels[n]];
+			glm::vec3 position = sampleVector(channel.positions, time, glm::vec3(0.0f));
+			glm::quat rotation = sampleQuat(channel.rotations, time);
+			glm::vec3 scale = sampleVector(channel.scales, time, glm::vec3(1.0f));
+			local = glm::translate(glm::mat4(1.0f), position) * glm::mat4_cast(rotation) * glm::scale(glm::mat4(1.0f), scale);
+		}
+		// parents come first, their global transform is already final
+		globals[n] = node.parent >= 0 ? globals[node.parent] * local : local;
+	}
+
+	for (size_t b = 0; b < bones->size(); b++)
+		bone_palette[b] = global_inverse * globals[(*bones)[b].node] * (*bones)[b].offset;
+}
+
+const std::vector<glm::mat4>& AnimationSampler::palette() const
+{
+	return bone_palette;
+}
+
+const std::vector<glm::mat4>& AnimationSampler::globalTransforms() const
+{
+	return globals;
+}
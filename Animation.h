@@ -0,0 +1,85 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <string>
+#include <vector>
+
+// Engine side copies of the scene graph and animation data so the Assimp
+// scene can be released right after import.
+
+// nodes are stored flattened, a parent always comes before its children
+struct SkeletonNode
+{
+	std::string name;
+	int parent;
+	glm::mat4 transform;
+};
+
+struct VectorKey
+{
+	float time;
+	glm::vec3 value;
+};
+
+struct QuatKey
+{
+	float time;
+	glm::quat value;
+};
+
+struct NodeAnimation
+{
+	int node;
+	std::vector<VectorKey> positions;
+	std::vector<QuatKey> rotations;
+	std::vector<VectorKey> scales;
+};
+
+struct AnimationClip
+{
+	std::string name;
+	float duration;
+	float ticksPerSecond;
+	std::vector<NodeAnimation> channels;
+};
+
+// bones a skinned model may have, CompactVertex stores bone IDs as bytes
+constexpr unsigned int MAX_BONES = 256;
+
+// joint a mesh is skinned to: the node it follows and the inverse bind
+// matrix taking mesh space into the node's space
+struct Bone
+{
+	int node;
+	glm::mat4 offset;
+};
+
+// Evaluates clips over the flattened skeleton: a single pass over the nodes
+// samples local transforms and concatenates them with the already finished
+// parent, then the palette is built from the bones' nodes. The skeleton,
+// bones and clips are referenced, not copied.
+class AnimationSampler
+{
+public:
+	AnimationSampler() = default;
+	AnimationSampler(const std::vector<SkeletonNode>& nodes, const std::vector<Bone>& bones,
+		const std::vector<AnimationClip>& clips);
+
+	// seconds wraps around the clip's duration
+	void evaluate(unsigned int clip, float seconds);
+	// globalInverse * node global * bone offset, one per bone
+	const std::vector<glm::mat4>& palette() const;
+	// per node, model space
+	const std::vector<glm::mat4>& globalTransforms() const;
+
+private:
+	const std::vector<SkeletonNode>* nodes = nullptr;
+	const std::vector<Bone>* bones = nullptr;
+	const std::vector<AnimationClip>* clips = nullptr;
+	// per clip, the channel driving each node or -1
+	std::vector<std::vector<int>> node_channels;
+	std::vector<glm::mat4> globals;
+	std::vector<glm::mat4> bone_palette;
+	glm::mat4 global_inverse = glm::mat4(1.0f);
+};
@@ -0,0 +1,155 @@
+#include "AnimationCompression.h"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+constexpr float SMALLEST_THREE_RANGE = 0.70710678f;
+constexpr float UNORM15_MAX = 32767.0f;
+
+glm::vec3 lerpKeys(const VectorKey& a, const VectorKey& b, float time)
+{
+	float span = b.time - a.time;
+	float f = span > 0.0f ? (time - a.time) / span : 0.0f;
+	return glm::mix(a.value, b.value, f);
+}
+
+glm::quat nlerpKeys(const QuatKey& a, const QuatKey& b, float time)
+{
+	float span = b.time - a.time;
+	float f = span > 0.0f ? (time - a.time) / span : 0.0f;
+	glm::quat to = glm::dot(a.value, b.value) < 0.0f ? -b.value : b.value;
+	return glm::normalize(a.value * (1.0f - f) + to * f);
+}
+
+float vectorError(const glm::vec3& a, const glm::vec3& b)
+{
+	return glm::length(a - b);
+}
+
+float rotationError(const glm::quat& a, const glm::quat& b)
+{
+	float d = std::min(std::abs(glm::dot(a, b)), 1.0f);
+	return 2.0f * std::acos(d);
+}
+
+// keeps the first and last key and, walking forward, the furthest key
+// every skipped key can be interpolated to within tolerance
+template<typename Key, typename Interpolate, typename Error>
+size_t reduceTrack(std::vector<Key>& keys, float tolerance, Interpolate interpolate, Error error)
+{
+	if (keys.size() < 2)
+		return 0;
+
+	// constant tracks collapse to their first key
+	bool constant = true;
+	for (size_t i = 1; i < keys.size() && constant; i++)
+		constant = error(keys[i].value, keys[0].value) <= tolerance;
+	if (constant)
+	{
+		size_t removed = keys.size() - 1;
+		keys.resize(1);
+		return removed;
+	}
+
+	std::vector<Key> kept;
+	kept.push_back(keys[0]);
+	size_t anchor = 0;
+	while (anchor + 1 < keys.size())
+	{
+		size_t end = anchor + 1;
+		for (size_t candidate = anchor + 2; candidate < keys.size(); candidate++)
+		{
+			bool fits = true;
+			for (size_t i = anchor + 1; i < candidate && fits; i++)
+				fits = error(interpolate(keys[anchor], keys[candidate], keys[i].time), keys[i].value) <= tolerance;
+			if (!fits)
+				break;
+			end = candidate;
+		}
+		kept.push_back(keys[end]);
+		anchor = end;
+	}
+
+	size_t removed = keys.size() - kept.size();
+	keys = std::move(kept);
+	return removed;
+}
+
+}
+
+size_t reduceKeys(AnimationClip& clip, const KeyTolerance& tolerance)
+{
+	size_t removed = 0;
+	for (auto& channel : clip.channels)
+	{
+		removed += reduceTrack(channel.positions, tolerance.translation, lerpKeys, vectorError);
+		removed += reduceTrack(channel.rotations, tolerance.rotation, nlerpKeys, rotationError);
+		removed += reduceTrack(channel.scales, tolerance.scale, lerpKeys, vectorError);
+	}
+	return removed;
+}
+
+size_t keyCount(const AnimationClip& clip)
+{
+	size_t count = 0;
+	for (auto& channel : clip.channels)
+		count += channel.positions.size() + channel.rotations.size() + channel.scales.size();
+	return count;
+}
+
+size_t keyBytes(const AnimationClip& clip)
+{
+	size_t bytes = 0;
+	for (auto& channel : clip.channels)
+		bytes += (channel.positions.size() + channel.scales.size()) * sizeof(VectorKey)
+			+ channel.rotations.size() * sizeof(QuatKey);
+	return bytes;
+}
+
+void packQuat(const glm::quat& q, uint16_t packed[3])
+{
+	float components[4] = { q.x, q.y, q.z, q.w };
+	int largest = 0;
+	for (int i = 1; i < 4; i++)
+		if (std::abs(components[i]) > std::abs(components[largest]))
+			largest = i;
+	// q and -q are the same rotation
+	float sign = components[largest] < 0.0f ? -1.0f : 1.0f;
+
+	int word = 0;
+	for (int i = 0; i < 4; i++)
+	{
+		if (i == largest)
+			continue;
+		float v = std::clamp(components[i] * sign, -SMALLEST_THREE_RANGE, SMALLEST_THREE_RANGE);
+		float t = (v + SMALLEST_THREE_RANGE) / (2.0f * SMALLEST_THREE_RANGE);
+		packed[word++] = (uint16_t)std::lround(t * UNORM15_MAX);
+	}
+	packed[0] |= (uint16_t)((largest & 1) << 15);
+	packed[1] |= (uint16_t)((largest >> 1) << 15);
+}
+
+glm::quat unpackQuat(const uint16_t packed[3])
+{
+	int largest = (packed[0] >> 15) | ((packed[1] >> 15) << 1);
+	float components[4];
+	float sum = 0.0f;
+	int word = 0;
+	for (int i = 0; i < 4; i++)
+	{
+		if (i == largest)
+			continue;
+		float t = (packed[word++] & 0x7fff) / UNORM15_MAX;
+		components[i] = t * 2.0f * SMALLEST_THREE_RANGE - SMALLEST_THREE_RANGE;
+		sum += components[i] * components[i];
+	}
+	components[largest] = std::sqrt(std::max(1.0f - sum, 0.0f));
+	return glm::quat(components[3], components[0], components[1], components[2]);
+}
+
+uint16_t packUnorm16(float value, float min, float extent)
+{
+	float t = extent > 0.0f ? (value - min) / extent : 0.0f;
+	return (uint16_t)std::lround(std::clamp(t, 0.0f, 1.0f) * 65535.0f);
+}
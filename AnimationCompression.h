@@ -0,0 +1,40 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <cstdint>
+#include <cstddef>
+#include "Animation.h"
+
+// largest deviation a dropped key may have from the interpolation of the
+// keys around it; translation in model units, rotation in radians
+struct KeyTolerance
+{
+	float translation = 1e-4f;
+	float rotation = 1e-3f;
+	float scale = 1e-4f;
+};
+
+// Error-bounded key reduction: greedily drops every key that lerp (nlerp
+// for rotations, as SimdSampler does) between the kept neighbours
+// reproduces within tolerance. Constant tracks end up with one key,
+// linear ones with two. Returns the number of keys removed.
+size_t reduceKeys(AnimationClip& clip, const KeyTolerance& tolerance);
+
+// keys of all tracks of a clip, and what they take in memory uncompressed
+size_t keyCount(const AnimationClip& clip);
+size_t keyBytes(const AnimationClip& clip);
+
+// Smallest three: the largest component is dropped (made positive so it
+// can be rebuilt from the others), the remaining three are stored as
+// 15-bit values in [-1/sqrt2, 1/sqrt2]; the dropped index takes the top
+// bits of the first two words.
+void packQuat(const glm::quat& q, uint16_t packed[3]);
+glm::quat unpackQuat(const uint16_t packed[3]);
+
+// unorm16 inside [min, min + extent]
+uint16_t packUnorm16(float value, float min, float extent);
+inline float unpackUnorm16(uint16_t value, float min, float extent)
+{
+	return min + value * (extent / 65535.0f);
+}
@@ -0,0 +1,57 @@
+#include "AnimationStage.h"
+#include "Mesh.h"
+
+int AnimationStage::add(const SoaClipSet& set, unsigned int clip, float timeOffset)
+{
+	if (set.clipCount() == 0 || set.boneCount() == 0)
+		return -1;
+
+	unsigned int offset = (unsigned int)palette_data.size();
+	characters.push_back({ SimdSampler(set), clip, timeOffset, offset });
+	palette_data.resize(offset + set.boneCount(), glm::mat4(1.0f));
+	return (int)offset;
+}
+
+void AnimationStage::update(float seconds, ThreadPool* pool)
+{
+	// characters only write their own slice of palette_data
+	auto sample = [this, seconds](size_t begin, size_t end) {
+		for (size_t c = begin; c < end; c++)
+		{
+			Character& character = characters[c];
+			character.sampler.evaluate(character.clip, seconds + character.timeOffset, &palette_data[character.offset]);
+		}
+	};
+	if (pool)
+		pool->parallelFor(characters.size(), ANIMATION_GRAIN, sample);
+	else
+		sample(0, characters.size());
+}
+
+void AnimationStage::upload()
+{
+	if (palette_data.empty())
+		return;
+
+	size_t size = palette_data.size() * sizeof(glm::mat4);
+	if (!buffer)
+		buffer = GLBuffer::create();
+
+	uploadOrphaned(GL_SHADER_STORAGE_BUFFER, buffer, capacity, palette_data.data(), size);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BONE_PALETTE_BUFFER_BINDING, buffer);
+}
+
+unsigned int AnimationStage::characterCount() const
+{
+	return (unsigned int)characters.size();
+}
+
+unsigned int AnimationStage::matrixCount() const
+{
+	return (unsigned int)palette_data.size();
+}
+
+const std::vector<glm::mat4>& AnimationStage::palettes() const
+{
+	return palette_data;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <vector>
+#include "GLHandle.h"
+#include "SimdSampler.h"
+#include "ThreadPool.h"
+
+// characters sampled per parallelFor chunk, one is a few microseconds
+constexpr size_t ANIMATION_GRAIN = 4;
+
+// Per-frame animation update of every skinned character in the scene. The
+// characters are sampled in parallel on a ThreadPool, each writing its
+// palette straight into its slice of one array, which is then uploaded to
+// the shader storage buffer at BONE_PALETTE_BUFFER_BINDING with a single
+// call. Draws pick their palette by offset into that buffer.
+class AnimationStage
+{
+public:
+	// a character playing clip of the set, timeOffset seconds ahead; the
+	// set has to outlive the stage. Returns the character's palette
+	// offset, -1 if the set has no clips or bones. Characters added back
+	// to back of the same set have consecutive palettes, as instanced
+	// draws expect.
+	int add(const SoaClipSet& set, unsigned int clip = 0, float timeOffset = 0.0f);
+
+	// samples every character at seconds, no GL calls; a null pool runs
+	// on the calling thread only
+	void update(float seconds, ThreadPool* pool = &ThreadPool::frame());
+	// uploads the palettes and binds the buffer, context thread only
+	void upload();
+
+	unsigned int characterCount() const;
+	unsigned int matrixCount() const;
+	const std::vector<glm::mat4>& palettes() const;
+
+private:
+	struct Character
+	{
+		SimdSampler sampler;
+		unsigned int clip;
+		float timeOffset;
+		unsigned int offset;
+	};
+	std::vector<Character> characters;
+	std::vector<glm::mat4> palette_data;
+	GLBuffer buffer;
+	size_t capacity = 0;
+};
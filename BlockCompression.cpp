@@ -0,0 +1,250 @@
+#include "BlockCompression.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+size_t CompressedImage::byteSize() const
+{
+	return levels.empty() ? 0 : levels.back().offset + levels.back().size;
+}
+
+int blockBytes(GLenum format)
+{
+	return format == GL_COMPRESSED_RGB_S3TC_DXT1_EXT || format == GL_COMPRESSED_RED_RGTC1 ? 8 : 16;
+}
+
+int formatChannels(GLenum format)
+{
+	switch (format)
+	{
+	case GL_COMPRESSED_RED_RGTC1: return 1;
+	case GL_COMPRESSED_RG_RGTC2: return 2;
+	case GL_COMPRESSED_RGB_S3TC_DXT1_EXT: return 3;
+	default: return 4;
+	}
+}
+
+size_t compressedLevelSize(GLenum format, int width, int height)
+{
+	return (size_t)std::max(1, (width + 3) / 4) * std::max(1, (height + 3) / 4) * blockBytes(format);
+}
+
+static unsigned short packRGB565(const float color[3])
+{
+	int r = (int)std::lround(std::clamp(color[0], 0.0f, 255.0f) * 31.0f / 255.0f);
+	int g = (int)std::lround(std::clamp(color[1], 0.0f, 255.0f) * 63.0f / 255.0f);
+	int b = (int)std::lround(std::clamp(color[2], 0.0f, 255.0f) * 31.0f / 255.0f);
+	return (unsigned short)((r << 11) | (g << 5) | b);
+}
+
+static void unpackRGB565(unsigned short packed, int color[3])
+{
+	int r = (packed >> 11) & 31, g = (packed >> 5) & 63, b = packed & 31;
+	color[0] = (r << 3) | (r >> 2);
+	color[1] = (g << 2) | (g >> 4);
+	color[2] = (b << 3) | (b >> 2);
+}
+
+// endpoints on the principal axis of the block's colours, 4-colour mode
+void encodeBC1Block(const unsigned char block[16][4], unsigned char* out)
+{
+	float mean[3] = { 0.0f, 0.0f, 0.0f };
+	for (int i = 0; i < 16; i++)
+		for (int c = 0; c < 3; c++)
+			mean[c] += block[i][c] / 16.0f;
+
+	float cov[6] = { 0.0f };
+	for (int i = 0; i < 16; i++)
+	{
+		float d[3] = { block[i][0] - mean[0], block[i][1] - mean[1], block[i][2] - mean[2] };
+		cov[0] += d[0] * d[0]; cov[1] += d[0] * d[1]; cov[2] += d[0] * d[2];
+		cov[3] += d[1] * d[1]; cov[4] += d[1] * d[2]; cov[5] += d[2] * d[2];
+	}
+
+	float axis[3] = { 1.0f, 1.0f, 1.0f };
+	for (int iteration = 0; iteration < 4; iteration++)
+	{
+		float next[3] = {
+			cov[0] * axis[0] + cov[1] * axis[1] + cov[2] * axis[2],
+			cov[1] * axis[0] + cov[3] * axis[1] + cov[4] * axis[2],
+			cov[2] * axis[0] + cov[4] * axis[1] + cov[5] * axis[2]
+		};
+		float length = std::sqrt(next[0] * next[0] + next[1] * next[1] + next[2] * next[2]);
+		if (length < 1e-6f)
+			break;
+		for (int c = 0; c < 3; c++)
+			axis[c] = next[c] / length;
+	}
+
+	float lo = 0.0f, hi = 0.0f;
+	for (int i = 0; i < 16; i++)
+	{
+		float t = (block[i][0] - mean[0]) * axis[0] + (block[i][1] - mean[1]) * axis[1] + (block[i][2] - mean[2]) * axis[2];
+		lo = std::min(lo, t);
+		hi = std::max(hi, t);
+	}
+	float end0[3], end1[3];
+	for (int c = 0; c < 3; c++)
+	{
+		end0[c] = mean[c] + axis[c] * hi;
+		end1[c] = mean[c] + axis[c] * lo;
+	}
+
+	unsigned short color0 = packRGB565(end0), color1 = packRGB565(end1);
+	if (color0 < color1)
+		std::swap(color0, color1);
+
+	unsigned int indices = 0;
+	if (color0 != color1)
+	{
+		int palette[4][3];
+		unpackRGB565(color0, palette[0]);
+		unpackRGB565(color1, palette[1]);
+		for (int c = 0; c < 3; c++)
+		{
+			palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+			palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+		}
+		for (int i = 0; i < 16; i++)
+		{
+			int best = 0, bestError = 1 << 30;
+			for (int p = 0; p < 4; p++)
+			{
+				int dr = block[i][0] - palette[p][0], dg = block[i][1] - palette[p][1], db = block[i][2] - palette[p][2];
+				int error = dr * dr + dg * dg + db * db;
+				if (error < bestError)
+				{
+					bestError = error;
+					best = p;
+				}
+			}
+			indices |= (unsigned int)best << (2 * i);
+		}
+	}
+
+	out[0] = color0 & 0xff; out[1] = color0 >> 8;
+	out[2] = color1 & 0xff; out[3] = color1 >> 8;
+	for (int i = 0; i < 4; i++)
+		out[4 + i] = (indices >> (8 * i)) & 0xff;
+}
+
+// min/max endpoints, 8-value mode
+void encodeBC4Block(const unsigned char values[16], unsigned char* out)
+{
+	unsigned char a0 = *std::max_element(values, values + 16);
+	unsigned char a1 = *std::min_element(values, values + 16);
+
+	unsigned long long indices = 0;
+	if (a0 != a1)
+	{
+		int palette[8] = { a0, a1 };
+		for (int p = 2; p < 8; p++)
+			palette[p] = ((8 - p) * a0 + (p - 1) * a1) / 7;
+		for (int i = 0; i < 16; i++)
+		{
+			int best = 0, bestError = 256;
+			for (int p = 0; p < 8; p++)
+			{
+				int error = std::abs(values[i] - palette[p]);
+				if (error < bestError)
+				{
+					bestError = error;
+					best = p;
+				}
+			}
+			indices |= (unsigned long long)best << (3 * i);
+		}
+	}
+
+	out[0] = a0;
+	out[1] = a1;
+	for (int i = 0; i < 6; i++)
+		out[2 + i] = (indices >> (8 * i)) & 0xff;
+}
+
+static void encodeLevel(const unsigned char* pixels, int width, int height, int channels, GLenum format, unsigned char* out)
+{
+	for (int by = 0; by < height; by += 4)
+		for (int bx = 0; bx < width; bx += 4)
+		{
+			// edge blocks repeat the last row/column
+			unsigned char block[16][4] = {};
+			for (int y = 0; y < 4; y++)
+				for (int x = 0; x < 4; x++)
+				{
+					const unsigned char* texel = pixels + ((size_t)std::min(by + y, height - 1) * width + std::min(bx + x, width - 1)) * channels;
+					for (int c = 0; c < channels; c++)
+						block[y * 4 + x][c] = texel[c];
+				}
+
+			unsigned char channel[16];
+			auto extract = [&](int c) {
+				for (int i = 0; i < 16; i++)
+					channel[i] = block[i][c];
+				return channel;
+			};
+
+			switch (format)
+			{
+			case GL_COMPRESSED_RED_RGTC1:
+				encodeBC4Block(extract(0), out);
+				break;
+			case GL_COMPRESSED_RG_RGTC2:
+				encodeBC4Block(extract(0), out);
+				encodeBC4Block(extract(1), out + 8);
+				break;
+			case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:
+				encodeBC1Block(block, out);
+				break;
+			default:
+				encodeBC4Block(extract(3), out);
+				encodeBC1Block(block, out + 8);
+				break;
+			}
+			out += blockBytes(format);
+		}
+}
+
+CompressedImage compressImage(const MipChain& chain)
+{
+	static const GLenum formats[] = { GL_COMPRESSED_RED_RGTC1, GL_COMPRESSED_RG_RGTC2, GL_COMPRESSED_RGB_S3TC_DXT1_EXT, GL_COMPRESSED_RGBA_S3TC_DXT5_EXT };
+
+	CompressedImage compressed;
+	if (chain.levels.empty() || chain.channels < 1 || chain.channels > 4)
+		return compressed;
+	compressed.format = formats[chain.channels - 1];
+
+	size_t offset = 0;
+	for (auto& level : chain.levels)
+	{
+		size_t size = compressedLevelSize(compressed.format, level.width, level.height);
+		compressed.levels.push_back({ level.width, level.height, offset, size });
+		offset += size;
+	}
+	compressed.storage.resize(offset);
+
+	for (size_t level = 0; level < chain.levels.size(); level++)
+	{
+		const MipChain::Level& source = chain.levels[level];
+		encodeLevel(chain.pixels.data() + source.offset, source.width, source.height, chain.channels,
+			compressed.format, compressed.storage.data() + compressed.levels[level].offset);
+	}
+	compressed.pixels = compressed.storage.data();
+	return compressed;
+}
+
+void uploadCompressedTexture(unsigned int textureID, const CompressedImage& image, StagingRing* staging)
+{
+	glBindTexture(GL_TEXTURE_2D, textureID);
+	glTexStorage2D(GL_TEXTURE_2D, (int)image.levels.size(), image.format, image.levels[0].width, image.levels[0].height);
+	for (int level = 0; level < (int)image.levels.size(); level++)
+	{
+		const CompressedImage::Level& l = image.levels[level];
+		if (staging)
+			staging->uploadCompressedTexture(textureID, level, l.width, l.height, image.format, image.pixels + l.offset, l.size);
+		else
+			glCompressedTexSubImage2D(GL_TEXTURE_2D, level, 0, 0, l.width, l.height, image.format, (GLsizei)l.size, image.pixels + l.offset);
+	}
+
+	setTextureSampling((int)image.levels.size());
+}
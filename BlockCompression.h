@@ -0,0 +1,45 @@
+#pragma once
+
+#include <glad/glad.h>
+#include "Mipmap.h"
+#include "MappedFile.h"
+#include "StagingRing.h"
+#include <vector>
+#include <cstddef>
+
+// Block compressed image with its whole mip chain. Levels are stored back
+// to back, either in storage (fresh encode) or in a mapped DDS file.
+struct CompressedImage
+{
+	struct Level
+	{
+		int width;
+		int height;
+		size_t offset;
+		size_t size;
+	};
+
+	// GL internal format, 0 if there is no image
+	GLenum format = 0;
+	std::vector<Level> levels;
+	std::vector<unsigned char> storage;
+	MappedFile file;
+	const unsigned char* pixels = nullptr;
+
+	size_t byteSize() const;
+};
+
+// 1 channel -> BC4, 2 -> BC5, 3 -> BC1, 4 -> BC3, every level of the chain;
+// CPU reference encoder, no GL calls
+CompressedImage compressImage(const MipChain& chain);
+
+// uploads every level, needs the context thread
+void uploadCompressedTexture(unsigned int textureID, const CompressedImage& image, StagingRing* staging = nullptr);
+
+int blockBytes(GLenum format);
+int formatChannels(GLenum format);
+size_t compressedLevelSize(GLenum format, int width, int height);
+
+// 8 bytes each, block is 16 texels in row order
+void encodeBC1Block(const unsigned char block[16][4], unsigned char* out);
+void encodeBC4Block(const unsigned char values[16], unsigned char* out);
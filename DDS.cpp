@@ -0,0 +1,132 @@
+#include "DDS.h"
+#include <fstream>
+#include <cstring>
+#include <cstdint>
+#include <algorithm>
+
+constexpr uint32_t DDS_MAGIC = 0x20534444; // "DDS "
+constexpr uint32_t DDSD_CAPS = 0x1, DDSD_HEIGHT = 0x2, DDSD_WIDTH = 0x4, DDSD_PIXELFORMAT = 0x1000,
+	DDSD_MIPMAPCOUNT = 0x20000, DDSD_LINEARSIZE = 0x80000;
+constexpr uint32_t DDPF_FOURCC = 0x4;
+constexpr uint32_t DDSCAPS_COMPLEX = 0x8, DDSCAPS_TEXTURE = 0x1000, DDSCAPS_MIPMAP = 0x400000;
+// GL_MAX_TEXTURE_SIZE of current hardware, readDDS runs on workers that
+// can't query it
+constexpr uint32_t MAX_DDS_DIMENSION = 16384;
+
+struct DDSPixelFormat
+{
+	uint32_t size;
+	uint32_t flags;
+	uint32_t fourCC;
+	uint32_t rgbBitCount;
+	uint32_t masks[4];
+};
+
+struct DDSHeader
+{
+	uint32_t size;
+	uint32_t flags;
+	uint32_t height;
+	uint32_t width;
+	uint32_t pitchOrLinearSize;
+	uint32_t depth;
+	uint32_t mipMapCount;
+	uint32_t reserved1[11];
+	DDSPixelFormat pixelFormat;
+	uint32_t caps[4];
+	uint32_t reserved2;
+};
+static_assert(sizeof(DDSHeader) == 124, "DDS header must be 124 bytes");
+
+static constexpr uint32_t fourCC(const char code[5])
+{
+	return (uint32_t)code[0] | ((uint32_t)code[1] << 8) | ((uint32_t)code[2] << 16) | ((uint32_t)code[3] << 24);
+}
+
+static const struct { uint32_t fourCC; GLenum format; } DDS_FORMATS[] = {
+	{ fourCC("DXT1"), GL_COMPRESSED_RGB_S3TC_DXT1_EXT },
+	{ fourCC("DXT5"), GL_COMPRESSED_RGBA_S3TC_DXT5_EXT },
+	{ fourCC("ATI1"), GL_COMPRESSED_RED_RGTC1 },
+	{ fourCC("ATI2"), GL_COMPRESSED_RG_RGTC2 },
+};
+
+bool readDDS(const std::string& path, CompressedImage& image)
+{
+	MappedFile file(path);
+	if (!file.isOpen() || file.size() < sizeof(uint32_t) + sizeof(DDSHeader))
+		return false;
+
+	uint32_t magic;
+	DDSHeader header;
+	std::memcpy(&magic, file.data(), sizeof(magic));
+	std::memcpy(&header, file.data() + sizeof(magic), sizeof(header));
+	if (magic != DDS_MAGIC || header.size != sizeof(DDSHeader) || !(header.pixelFormat.flags & DDPF_FOURCC))
+		return false;
+
+	GLenum format = 0;
+	for (auto& entry : DDS_FORMATS)
+		if (entry.fourCC == header.pixelFormat.fourCC)
+			format = entry.format;
+	if (!format)
+		return false;
+
+	if (header.width == 0 || header.height == 0 || header.width > MAX_DDS_DIMENSION || header.height > MAX_DDS_DIMENSION)
+		return false;
+	int width = (int)header.width, height = (int)header.height;
+	uint32_t levels = std::max(1u, header.mipMapCount);
+	// glTexStorage2D rejects more levels than the chain has
+	if (levels > (uint32_t)mipLevelCount(width, height))
+		return false;
+
+	CompressedImage result;
+	result.format = format;
+	size_t offset = sizeof(magic) + sizeof(header);
+	for (uint32_t level = 0; level < levels; level++)
+	{
+		size_t size = compressedLevelSize(format, width, height);
+		result.levels.push_back({ width, height, offset, size });
+		offset += size;
+		width = std::max(1, width / 2);
+		height = std::max(1, height / 2);
+	}
+	if (offset > file.size())
+		return false;
+
+	// offsets are relative to the file, pixels points at its start
+	result.pixels = file.data();
+	result.file = std::move(file);
+	image = std::move(result);
+	return true;
+}
+
+bool writeDDS(const std::string& path, const CompressedImage& image)
+{
+	if (!image.format || image.levels.empty())
+		return false;
+
+	DDSHeader header = {};
+	header.size = sizeof(DDSHeader);
+	header.flags = DDSD_CAPS | DDSD_HEIGHT | DDSD_WIDTH | DDSD_PIXELFORMAT | DDSD_MIPMAPCOUNT | DDSD_LINEARSIZE;
+	header.width = (uint32_t)image.levels[0].width;
+	header.height = (uint32_t)image.levels[0].height;
+	header.pitchOrLinearSize = (uint32_t)image.levels[0].size;
+	header.mipMapCount = (uint32_t)image.levels.size();
+	header.pixelFormat.size = sizeof(DDSPixelFormat);
+	header.pixelFormat.flags = DDPF_FOURCC;
+	for (auto& entry : DDS_FORMATS)
+		if (entry.format == image.format)
+			header.pixelFormat.fourCC = entry.fourCC;
+	header.caps[0] = DDSCAPS_TEXTURE | DDSCAPS_COMPLEX | DDSCAPS_MIPMAP;
+
+	// several decodes may write the same file
+	std::string temporary = temporaryPath(path);
+	std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+	if (!out)
+		return false;
+	out.write(reinterpret_cast<const char*>(&DDS_MAGIC), sizeof(DDS_MAGIC));
+	out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	for (auto& level : image.levels)
+		out.write(reinterpret_cast<const char*>(image.pixels + level.offset), level.size);
+	out.close();
+	return replaceFile(temporary, path, (bool)out);
+}
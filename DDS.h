@@ -0,0 +1,9 @@
+#pragma once
+
+#include "BlockCompression.h"
+#include <string>
+
+// DDS container for BC1/BC3 (DXT1/DXT5) and BC4/BC5 (ATI1/ATI2) images
+// with mip chains, the layout GL expects for glCompressedTexImage2D.
+bool readDDS(const std::string& path, CompressedImage& image);
+bool writeDDS(const std::string& path, const CompressedImage& image);
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <cstddef>
+
+// Move-only owner of a GL object name, the object is deleted with the handle.
+// Converts to the raw name so it can be passed straight to GL calls.
+template<typename Traits>
+class GLHandle
+{
+public:
+	GLHandle() = default;
+	explicit GLHandle(unsigned int id) : id(id) {}
+	GLHandle(const GLHandle&) = delete;
+	GLHandle& operator=(const GLHandle&) = delete;
+
+	GLHandle(GLHandle&& other) noexcept : id(other.release()) {}
+	GLHandle& operator=(GLHandle&& other) noexcept
+	{
+		if (this != &other)
+			reset(other.release());
+		return *this;
+	}
+
+	~GLHandle()
+	{
+		reset();
+	}
+
+	static GLHandle create()
+	{
+		return GLHandle(Traits::create());
+	}
+
+	unsigned int get() const
+	{
+		return id;
+	}
+
+	operator unsigned int() const
+	{
+		return id;
+	}
+
+	unsigned int release()
+	{
+		unsigned int released = id;
+		id = 0;
+		return released;
+	}
+
+	void reset(unsigned int name = 0)
+	{
+		if (id)
+			Traits::destroy(id);
+		id = name;
+	}
+
+private:
+	unsigned int id = 0;
+};
+
+struct BufferTraits
+{
+	static unsigned int create() { unsigned int id; glGenBuffers(1, &id); return id; }
+	static void destroy(unsigned int id) { glDeleteBuffers(1, &id); }
+};
+
+struct VertexArrayTraits
+{
+	static unsigned int create() { unsigned int id; glGenVertexArrays(1, &id); return id; }
+	static void destroy(unsigned int id) { glDeleteVertexArrays(1, &id); }
+};
+
+struct TextureTraits
+{
+	static unsigned int create() { unsigned int id; glGenTextures(1, &id); return id; }
+	static void destroy(unsigned int id) { glDeleteTextures(1, &id); }
+};
+
+using GLBuffer = GLHandle<BufferTraits>;
+using GLVertexArray = GLHandle<VertexArrayTraits>;
+using GLTexture = GLHandle<TextureTraits>;
+
+// Replaces the contents of a stream buffer with size bytes. Storage grows
+// when they don't fit, otherwise the old storage is orphaned so the upload
+// doesn't wait on last frame's draws. Leaves target unbound.
+inline void uploadOrphaned(GLenum target, unsigned int buffer, size_t& capacity, const void* data, size_t size)
+{
+	glBindBuffer(target, buffer);
+	if (size > capacity)
+	{
+		capacity = size;
+		glBufferData(target, size, data, GL_STREAM_DRAW);
+	}
+	else
+	{
+		glBufferData(target, capacity, nullptr, GL_STREAM_DRAW);
+		glBufferSubData(target, 0, size, data);
+	}
+	glBindBuffer(target, 0);
+}
@@ -0,0 +1,69 @@
+#include "Image.h"
+#include "stb_image.h"
+#include <algorithm>
+
+void ImageDeleter::operator()(unsigned char* pixels) const
+{
+	stbi_image_free(pixels);
+}
+
+Image decodeImageMemory(const unsigned char* data, size_t size)
+{
+	Image image;
+	image.pixels.reset(stbi_load_from_memory(data, (int)size, &image.width, &image.height, &image.channels, 0));
+	return image;
+}
+
+GLenum pixelFormat(int channels)
+{
+	static const GLenum formats[] = { GL_RED, GL_RG, GL_RGB, GL_RGBA };
+	return formats[channels - 1];
+}
+
+GLenum internalFormat(int channels)
+{
+	static const GLenum formats[] = { GL_R8, GL_RG8, GL_RGB8, GL_RGBA8 };
+	return formats[channels - 1];
+}
+
+int mipLevelCount(int width, int height)
+{
+	int levels = 1;
+	while (width > 1 || height > 1)
+	{
+		width = std::max(1, width / 2);
+		height = std::max(1, height / 2);
+		levels++;
+	}
+	return levels;
+}
+
+void setTextureSampling(int levels, GLenum target)
+{
+	glTexParameteri(target, GL_TEXTURE_MAX_LEVEL, levels - 1);
+	glTexParameteri(target, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(target, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	glTexParameteri(target, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+}
+
+void uploadTexture(unsigned int textureID, const Image& image, StagingRing* staging)
+{
+	GLenum format = pixelFormat(image.channels);
+	int levels = mipLevelCount(image.width, image.height);
+
+	glBindTexture(GL_TEXTURE_2D, textureID);
+	glTexStorage2D(GL_TEXTURE_2D, levels, internalFormat(image.channels), image.width, image.height);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	if (staging)
+	{
+		size_t size = (size_t)image.width * image.height * image.channels;
+		staging->uploadTexture(textureID, 0, image.width, image.height, format, GL_UNSIGNED_BYTE, image.pixels.get(), size);
+	}
+	else
+		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, image.width, image.height, format, GL_UNSIGNED_BYTE, image.pixels.get());
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	glGenerateMipmap(GL_TEXTURE_2D);
+
+	setTextureSampling(levels);
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <glad/glad.h>
+#include "StagingRing.h"
+#include <memory>
+#include <string>
+
+struct ImageDeleter
+{
+	void operator()(unsigned char* pixels) const;
+};
+
+// 8-bit image decoded by stb_image, pixels is null if decoding failed
+struct Image
+{
+	int width = 0;
+	int height = 0;
+	int channels = 0;
+	std::unique_ptr<unsigned char, ImageDeleter> pixels;
+};
+
+// safe to call from any thread, no GL calls
+Image decodeImageMemory(const unsigned char* data, size_t size);
+
+// unsized transfer format and sized internal format of 1-4 channel 8-bit data
+GLenum pixelFormat(int channels);
+GLenum internalFormat(int channels);
+int mipLevelCount(int width, int height);
+// repeat wrapping and trilinear filtering of the texture bound to target
+void setTextureSampling(int levels, GLenum target = GL_TEXTURE_2D);
+
+// allocates immutable storage for the texture name, uploads level 0 and
+// builds the mips with glGenerateMipmap; needs the context thread, goes
+// through a pixel unpack buffer when staging is given
+void uploadTexture(unsigned int textureID, const Image& image, StagingRing* staging = nullptr);
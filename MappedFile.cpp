@@ -0,0 +1,145 @@
+#include "MappedFile.h"
+#include <utility>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <sstream>
+#include <thread>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile(const std::string& path)
+{
+#ifdef _WIN32
+	HANDLE handle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (handle == INVALID_HANDLE_VALUE)
+		return;
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(handle, &fileSize) || fileSize.QuadPart == 0)
+	{
+		CloseHandle(handle);
+		return;
+	}
+	HANDLE map = CreateFileMappingA(handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (!map)
+	{
+		CloseHandle(handle);
+		return;
+	}
+	void* address = MapViewOfFile(map, FILE_MAP_READ, 0, 0, 0);
+	if (!address)
+	{
+		CloseHandle(map);
+		CloseHandle(handle);
+		return;
+	}
+	file = handle;
+	mapping = map;
+	view = static_cast<const unsigned char*>(address);
+	length = (size_t)fileSize.QuadPart;
+#else
+	int fd = open(path.c_str(), O_RDONLY);
+	if (fd < 0)
+		return;
+	struct stat info;
+	if (fstat(fd, &info) != 0 || info.st_size == 0)
+	{
+		::close(fd);
+		return;
+	}
+	void* address = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	// the mapping stays valid after the descriptor is closed
+	::close(fd);
+	if (address == MAP_FAILED)
+		return;
+	view = static_cast<const unsigned char*>(address);
+	length = (size_t)info.st_size;
+#endif
+}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept
+{
+	*this = std::move(other);
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept
+{
+	if (this != &other)
+	{
+		close();
+		std::swap(view, other.view);
+		std::swap(length, other.length);
+#ifdef _WIN32
+		std::swap(file, other.file);
+		std::swap(mapping, other.mapping);
+#endif
+	}
+	return *this;
+}
+
+MappedFile::~MappedFile()
+{
+	close();
+}
+
+bool MappedFile::isOpen() const
+{
+	return view != nullptr;
+}
+
+const unsigned char* MappedFile::data() const
+{
+	return view;
+}
+
+size_t MappedFile::size() const
+{
+	return length;
+}
+
+void MappedFile::close()
+{
+	if (!view)
+		return;
+#ifdef _WIN32
+	UnmapViewOfFile(view);
+	CloseHandle(mapping);
+	CloseHandle(file);
+	file = nullptr;
+	mapping = nullptr;
+#else
+	munmap(const_cast<unsigned char*>(view), length);
+#endif
+	view = nullptr;
+	length = 0;
+}
+
+std::string temporaryPath(const std::string& path)
+{
+	static std::atomic<unsigned int> counter{ 0 };
+	std::ostringstream temporary;
+	temporary << path << '.' << std::hex << std::hash<std::thread::id>()(std::this_thread::get_id())
+		<< '.' << std::chrono::steady_clock::now().time_since_epoch().count() << '.' << counter++ << ".tmp";
+	return temporary.str();
+}
+
+bool replaceFile(const std::string& temporary, const std::string& path, bool written)
+{
+	std::error_code error;
+	if (written)
+		std::filesystem::rename(temporary, path, error);
+	if (!written || error)
+	{
+		std::filesystem::remove(temporary, error);
+		return false;
+	}
+	return true;
+}
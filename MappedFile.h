@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+// Read-only memory mapping of a whole file.
+class MappedFile
+{
+public:
+	MappedFile() = default;
+	explicit MappedFile(const std::string& path);
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+	MappedFile(MappedFile&& other) noexcept;
+	MappedFile& operator=(MappedFile&& other) noexcept;
+	~MappedFile();
+
+	bool isOpen() const;
+	const unsigned char* data() const;
+	size_t size() const;
+
+private:
+	const unsigned char* view = nullptr;
+	size_t length = 0;
+#ifdef _WIN32
+	void* file = nullptr;
+	void* mapping = nullptr;
+#endif
+
+	void close();
+};
+
+// Unique name next to path to write a file under before replaceFile moves
+// it over path, so readers and existing mappings only see complete files.
+std::string temporaryPath(const std::string& path);
+// renames temporary to path if written, otherwise or on failure removes it
+bool replaceFile(const std::string& temporary, const std::string& path, bool written);
@@ -1,80 +1,97 @@
 #include "Mesh.h"
 
-Mesh::Mesh(std::vector<Vertex> &vertices, std::vector<unsigned int> &indices, std::vector<Texture> &textures, Material& material)
-	:vertices(vertices), indices(indices), textures(textures),  material(material) {
-	setupMesh();
+Mesh::Mesh(std::vector<Vertex> vertices, std::vector<unsigned int> indices, std::vector<Texture> textures, const Material& material)
+	:vertices(std::move(vertices)), indices(std::move(indices)), textures(std::move(textures)),  material(material) {
+	indexCount = (unsigned int)this->indices.size();
+	vertexCount = (unsigned int)this->vertices.size();
 };
 
 Mesh::~Mesh() {
 
 }
 
-void Mesh::Draw(Shader& shader, bool textured)
+void Mesh::releaseGeometry()
 {
-	unsigned int diffuseNr = 1;
-	unsigned int specularNr = 1;
-
-	if (textured) {
-		for (unsigned int i = 0; i < textures.size(); i++)
-		{
-			glActiveTexture(GL_TEXTURE0 + i);
-			std::string number;
-			std::string name = textures[i].type;
-			if (name == "texture_diffuse")
-				number = std::to_string(diffuseNr++);
-			else if (name == "texture_specular")
-				number = std::to_string(specularNr++);
-			shader.use();
-			shader.setVec3("material.ambient", material.ambient);
-			shader.setVec3("material.diffuse", material.diffuse);
-			shader.setVec3("material.specular", material.specular);
-			shader.setFloat("material.shininess", material.shininess);
-			shader.setBool("textured", true);
-			shader.setFloat((name + number).c_str(), i);
-			glBindTexture(GL_TEXTURE_2D, textures[i].id);
-		}
-	}
-	else {
-		shader.use();
-		shader.setVec3("material.ambient", material.ambient);
-		shader.setVec3("material.diffuse", material.diffuse);
-		shader.setVec3("material.specular", material.specular);
-		shader.setFloat("material.shininess", material.shininess);
-		shader.setBool("textured", false);
-	}
-	
-	glBindVertexArray(VAO);
-	glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
-	glBindVertexArray(0);
-
-	glActiveTexture(GL_TEXTURE0);
+	std::vector<Vertex>().swap(vertices);
+	std::vector<unsigned int>().swap(indices);
+	std::vector<uint16_t>().swap(shortIndices);
 }
 
-void Mesh::setupMesh()
+void Mesh::narrowIndices()
 {
-	glGenBuffers(1, &VBO);
-	glGenBuffers(1, &EBO);
-	glGenVertexArrays(1, &VAO);
+	if (indexType != GL_UNSIGNED_INT || vertexCount > MAX_SHORT_INDEX_VERTICES)
+		return;
+	shortIndices.assign(indices.begin(), indices.end());
+	std::vector<unsigned int>().swap(indices);
+	indexType = GL_UNSIGNED_SHORT;
+}
 
-	glBindVertexArray(VAO);
-	
-	glBindBuffer(GL_ARRAY_BUFFER, VBO);
-	glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);
+size_t Mesh::indexSize() const
+{
+	return indexType == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(unsigned int);
+}
 
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
+const void* Mesh::indexData() const
+{
+	return indexType == GL_UNSIGNED_SHORT ? (const void*)shortIndices.data() : (const void*)indices.data();
+}
 
-	glEnableVertexAttribArray(0);
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
+MeshUniforms::MeshUniforms(const Shader& shader)
+{
+	ambient = shader.getUniformLocation("material.ambient");
+	diffuse = shader.getUniformLocation("material.diffuse");
+	specular = shader.getUniformLocation("material.specular");
+	shininess = shader.getUniformLocation("material.shininess");
+	model = shader.getUniformLocation("model");
+	textured = shader.getUniformLocation("textured");
+	animated = shader.getUniformLocation("animated");
+	drawOffset = shader.getUniformLocation("drawOffset");
+	diffuseLayer = shader.getUniformLocation("diffuseLayer");
+	positionOffset = shader.getUniformLocation("positionOffset");
+	positionScale = shader.getUniformLocation("positionScale");
+	boneOffset = shader.getUniformLocation("boneOffset");
+	boneStride = shader.getUniformLocation("boneStride");
+	paletteCount = shader.getUniformLocation("paletteCount");
+	for (unsigned int i = 0; i < MAX_SAMPLERS_PER_TYPE; i++)
+	{
+		texture_diffuse[i] = shader.getUniformLocation("texture_diffuse" + std::to_string(i + 1));
+		texture_specular[i] = shader.getUniformLocation("texture_specular" + std::to_string(i + 1));
+	}
+}
 
-	glEnableVertexAttribArray(1);
-	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
+void Mesh::Draw(Shader& shader, const MeshUniforms& uniforms, bool textured, GLsizei instanceCount)
+{
+	shader.use();
+	shader.setVec3(uniforms.ambient, material.ambient);
+	shader.setVec3(uniforms.diffuse, material.diffuse);
+	shader.setVec3(uniforms.specular, material.specular);
+	shader.setFloat(uniforms.shininess, material.shininess);
+	shader.setBool(uniforms.textured, textured);
+	shader.setVec3(uniforms.positionOffset, positionOffset);
+	shader.setVec3(uniforms.positionScale, positionScale);
 
-	glEnableVertexAttribArray(2);
-	glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
-	
-	
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+	if (textured) {
+		unsigned int diffuseNr = 0;
+		unsigned int specularNr = 0;
+		for (unsigned int i = 0; i < textures.size(); i++)
+		{
+			glActiveTexture(GL_TEXTURE0 + i);
+			const std::string& name = textures[i].type;
+			if (name == "texture_diffuse" && diffuseNr < MAX_SAMPLERS_PER_TYPE)
+			{
+				if (diffuseNr == 0)
+					shader.setInt(uniforms.diffuseLayer, textures[i].layer);
+				shader.setInt(uniforms.texture_diffuse[diffuseNr++], i);
+			}
+			else if (name == "texture_specular" && specularNr < MAX_SAMPLERS_PER_TYPE)
+				shader.setInt(uniforms.texture_specular[specularNr++], i);
+			glBindTexture(GL_TEXTURE_2D_ARRAY, textures[i].id);
+		}
+		glActiveTexture(GL_TEXTURE0);
+	}
 
-	glBindVertexArray(0);
+	if (instanceCount == 1)
+		glDrawElementsBaseVertex(GL_TRIANGLES, indexCount, indexType, (void*)indexOffset, baseVertex);
+	else
+		glDrawElementsInstancedBaseVertex(GL_TRIANGLES, indexCount, indexType, (void*)indexOffset, instanceCount, baseVertex);
 }
\ No newline at end of file
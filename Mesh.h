@@ -6,21 +6,38 @@
 #include <string>
 #include <vector>
 #include <optional>
+#include <cstdint>
 #include "Shader.h"
 constexpr auto NUM_BONES_PER_VERTEX = 4;
+constexpr auto WEIGHTS_PER_VERTEX = 4;
+static_assert(WEIGHTS_PER_VERTEX == NUM_BONES_PER_VERTEX, "every bone influence needs a weight");
+constexpr auto MAX_SAMPLERS_PER_TYPE = 4;
+constexpr unsigned int MATERIAL_BUFFER_BINDING = 2;
+constexpr unsigned int QUANTIZATION_BUFFER_BINDING = 3;
+constexpr unsigned int BONE_PALETTE_BUFFER_BINDING = 4;
+// meshes with at most this many vertices are drawn with 16-bit indices
+constexpr size_t MAX_SHORT_INDEX_VERTICES = 65536;
 
 struct Vertex
 {
 	glm::vec3 Position;
 	glm::vec3 Normal;
 	glm::vec2 TexCoords;
+	// strongest influences, weights sum to 1; all zero on static meshes
+	int BoneIDs[NUM_BONES_PER_VERTEX] = {};
+	float Weights[WEIGHTS_PER_VERTEX] = {};
 };
 
+// id is a GL_TEXTURE_2D_ARRAY once the model is uploaded, layer is where
+// this texture sits in it
 struct Texture
 {
 	unsigned int id;
 	std::string type;
 	std::string path;
+	int layer = 0;
+	// resident bindless handle, 0 without ARB_bindless_texture
+	uint64_t handle = 0;
 };
 
 struct Material
@@ -29,20 +46,84 @@ struct Material
 	float shininess;
 };
 
+// std430 element of the Materials buffer read by mesh.frag under MULTI_DRAW,
+// the maps are bindless handles sampled under BINDLESS
+struct DrawMaterial
+{
+	glm::vec4 ambient, diffuse, specular;
+	uint64_t diffuseMap;
+	uint64_t specularMap;
+	float shininess;
+	int textured;
+	int diffuseLayer;
+	int specularLayer;
+};
+static_assert(sizeof(DrawMaterial) == 80, "DrawMaterial must match std430 DrawMaterial");
+
+// std430 element of the Quantization buffer read by mesh.vert under
+// MULTI_DRAW and COMPACT_VERTEX
+struct DrawQuantization
+{
+	glm::vec4 offset;
+	glm::vec4 scale;
+};
+
+struct DrawElementsIndirectCommand
+{
+	unsigned int count;
+	unsigned int instanceCount;
+	unsigned int firstIndex;
+	int baseVertex;
+	unsigned int baseInstance;
+};
+
+// uniform locations used by Mesh::Draw, resolved once per shader program
+struct MeshUniforms
+{
+	int ambient, diffuse, specular, shininess;
+	int model, textured, animated, drawOffset, diffuseLayer;
+	int positionOffset, positionScale, boneOffset, boneStride, paletteCount;
+	int texture_diffuse[MAX_SAMPLERS_PER_TYPE];
+	int texture_specular[MAX_SAMPLERS_PER_TYPE];
+
+	MeshUniforms(const Shader& shader);
+};
+
+// a sub-mesh of a Model, its geometry lives in the model's shared vertex
+// and index buffers at baseVertex / indexOffset
 class Mesh
 {
 public:
 	std::vector<Vertex> vertices;
+	// only one of the two is filled, matching indexType
 	std::vector<unsigned int> indices;
+	std::vector<uint16_t> shortIndices;
 	std::vector<Texture> textures;
 	Material material;
+	unsigned int baseVertex = 0;
+	// in bytes, 16-bit and 32-bit ranges share the model's index buffer
+	size_t indexOffset = 0;
+	GLenum indexType = GL_UNSIGNED_INT;
+	unsigned int indexCount = 0;
+	unsigned int vertexCount = 0;
+	// dequantization of compact vertices, identity for the float layout
+	glm::vec3 positionOffset = glm::vec3(0.0f);
+	glm::vec3 positionScale = glm::vec3(1.0f);
 
-	Mesh(std::vector<Vertex> &vertices, std::vector<unsigned int> &indices, std::vector<Texture> &textures, Material& material);
+	Mesh(std::vector<Vertex> vertices, std::vector<unsigned int> indices, std::vector<Texture> textures, const Material& material);
+	Mesh(const Mesh&) = delete;
+	Mesh& operator=(const Mesh&) = delete;
+	Mesh(Mesh&&) = default;
+	Mesh& operator=(Mesh&&) = default;
 	~Mesh();
-	void Draw(Shader& shader, bool textured);
-private:
-	unsigned int VAO, VBO, EBO;
-	void setupMesh();
+	// frees the CPU copy of the geometry once it lives in the model's buffers
+	void releaseGeometry();
+	// moves indices into shortIndices if the vertex count allows it
+	void narrowIndices();
+	size_t indexSize() const;
+	const void* indexData() const;
+	// expects the owning model's VAO to be bound
+	void Draw(Shader& shader, const MeshUniforms& uniforms, bool textured, GLsizei instanceCount = 1);
 };
 
 
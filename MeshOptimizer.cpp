@@ -0,0 +1,250 @@
+#include "MeshOptimizer.h"
+#include "Hash.h"
+#include <algorithm>
+#include <cstring>
+#include <numeric>
+#include <unordered_map>
+
+VertexCacheStats analyzeVertexCache(const std::vector<unsigned int>& indices, size_t vertexCount, unsigned int cacheSize)
+{
+	VertexCacheStats stats;
+	if (indices.empty())
+		return stats;
+
+	// FIFO: a vertex is cached while fewer than cacheSize misses happened since its own
+	std::vector<size_t> missTime(vertexCount, 0);
+	std::vector<bool> referenced(vertexCount, false);
+	size_t misses = 0, unique = 0;
+	for (unsigned int v : indices)
+	{
+		if (!referenced[v])
+		{
+			referenced[v] = true;
+			unique++;
+		}
+		if (missTime[v] == 0 || misses + 1 - missTime[v] > cacheSize)
+			missTime[v] = ++misses;
+	}
+	stats.acmr = (float)misses / (indices.size() / 3);
+	stats.atvr = (float)misses / unique;
+	return stats;
+}
+
+namespace {
+
+struct VertexBytesHash
+{
+	size_t operator()(const Vertex& v) const { return (size_t)fnv1a(&v, sizeof(Vertex)); }
+};
+
+struct VertexBytesEqual
+{
+	bool operator()(const Vertex& a, const Vertex& b) const { return std::memcmp(&a, &b, sizeof(Vertex)) == 0; }
+};
+
+}
+
+size_t deduplicateVertices(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices)
+{
+	std::unordered_map<Vertex, unsigned int, VertexBytesHash, VertexBytesEqual> unique;
+	unique.reserve(vertices.size());
+	std::vector<unsigned int> remap(vertices.size());
+	std::vector<Vertex> merged;
+	merged.reserve(vertices.size());
+	for (size_t i = 0; i < vertices.size(); i++)
+	{
+		auto inserted = unique.emplace(vertices[i], (unsigned int)merged.size());
+		if (inserted.second)
+			merged.push_back(vertices[i]);
+		remap[i] = inserted.first->second;
+	}
+	for (unsigned int& index : indices)
+		index = remap[index];
+
+	size_t removed = vertices.size() - merged.size();
+	vertices = std::move(merged);
+	return removed;
+}
+
+void optimizeVertexCache(std::vector<unsigned int>& indices, size_t vertexCount, std::vector<size_t>* clusters, unsigned int cacheSize)
+{
+	size_t triangleCount = indices.size() / 3;
+	if (clusters)
+		clusters->clear();
+	if (triangleCount == 0)
+		return;
+
+	// triangles around each vertex
+	std::vector<unsigned int> live(vertexCount, 0);
+	for (unsigned int v : indices)
+		live[v]++;
+	std::vector<size_t> offsets(vertexCount + 1, 0);
+	for (size_t v = 0; v < vertexCount; v++)
+		offsets[v + 1] = offsets[v] + live[v];
+	std::vector<unsigned int> adjacency(indices.size());
+	std::vector<size_t> fill(offsets.begin(), offsets.end() - 1);
+	for (size_t i = 0; i < indices.size(); i++)
+		adjacency[fill[indices[i]]++] = (unsigned int)(i / 3);
+
+	std::vector<size_t> cacheTime(vertexCount, 0);
+	std::vector<bool> emitted(triangleCount, false);
+	std::vector<unsigned int> deadEnd;
+	std::vector<unsigned int> candidates;
+	std::vector<unsigned int> result;
+	result.reserve(indices.size());
+	size_t timestamp = cacheSize + 1;
+	size_t cursor = 0;
+
+	auto skipDeadEnd = [&]() -> long long {
+		while (!deadEnd.empty())
+		{
+			unsigned int v = deadEnd.back();
+			deadEnd.pop_back();
+			if (live[v] > 0)
+				return v;
+		}
+		while (cursor < vertexCount)
+		{
+			if (live[cursor] > 0)
+				return (long long)cursor;
+			cursor++;
+		}
+		return -1;
+	};
+
+	long long fanning = skipDeadEnd();
+	if (clusters && fanning >= 0)
+		clusters->push_back(0);
+	while (fanning >= 0)
+	{
+		candidates.clear();
+		for (size_t a = offsets[fanning]; a < offsets[fanning + 1]; a++)
+		{
+			unsigned int t = adjacency[a];
+			if (emitted[t])
+				continue;
+			emitted[t] = true;
+			for (int k = 0; k < 3; k++)
+			{
+				unsigned int v = indices[t * 3 + k];
+				result.push_back(v);
+				deadEnd.push_back(v);
+				candidates.push_back(v);
+				live[v]--;
+				if (timestamp - cacheTime[v] > cacheSize)
+					cacheTime[v] = timestamp++;
+			}
+		}
+
+		// the candidate that stays in the cache the longest once fanned
+		long long best = -1;
+		long long bestPriority = -1;
+		for (unsigned int v : candidates)
+		{
+			if (live[v] == 0)
+				continue;
+			long long priority = 0;
+			if (timestamp - cacheTime[v] + 2 * live[v] <= cacheSize)
+				priority = (long long)(timestamp - cacheTime[v]);
+			if (priority > bestPriority)
+			{
+				bestPriority = priority;
+				best = v;
+			}
+		}
+		if (best < 0)
+		{
+			best = skipDeadEnd();
+			if (clusters && best >= 0 && result.size() / 3 < triangleCount)
+				clusters->push_back(result.size() / 3);
+		}
+		fanning = best;
+	}
+
+	indices = std::move(result);
+}
+
+void optimizeOverdraw(std::vector<unsigned int>& indices, const std::vector<Vertex>& vertices, const std::vector<size_t>& clusters)
+{
+	size_t triangleCount = indices.size() / 3;
+	if (clusters.size() < 2)
+		return;
+
+	glm::vec3 meshCentroid(0.0f);
+	for (unsigned int v : indices)
+		meshCentroid += vertices[v].Position;
+	meshCentroid /= (float)indices.size();
+
+	struct Cluster
+	{
+		size_t first, end;
+		float sortKey;
+	};
+	std::vector<Cluster> sorted;
+	for (size_t c = 0; c < clusters.size(); c++)
+	{
+		Cluster cluster{ clusters[c], c + 1 < clusters.size() ? clusters[c + 1] : triangleCount, 0.0f };
+		glm::vec3 centroid(0.0f), normal(0.0f);
+		float area = 0.0f;
+		for (size_t t = cluster.first; t < cluster.end; t++)
+		{
+			const glm::vec3& p0 = vertices[indices[t * 3]].Position;
+			const glm::vec3& p1 = vertices[indices[t * 3 + 1]].Position;
+			const glm::vec3& p2 = vertices[indices[t * 3 + 2]].Position;
+			glm::vec3 n = glm::cross(p1 - p0, p2 - p0);
+			float a = glm::length(n);
+			centroid += (p0 + p1 + p2) * (a / 3.0f);
+			normal += n;
+			area += a;
+		}
+		float normalLength = glm::length(normal);
+		if (area > 0.0f && normalLength > 0.0f)
+			cluster.sortKey = glm::dot(centroid / area - meshCentroid, normal / normalLength);
+		sorted.push_back(cluster);
+	}
+	std::stable_sort(sorted.begin(), sorted.end(), [](const Cluster& a, const Cluster& b) { return a.sortKey > b.sortKey; });
+
+	std::vector<unsigned int> result;
+	result.reserve(indices.size());
+	for (const Cluster& cluster : sorted)
+		result.insert(result.end(), indices.begin() + cluster.first * 3, indices.begin() + cluster.end * 3);
+	indices = std::move(result);
+}
+
+void optimizeVertexFetch(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices)
+{
+	constexpr unsigned int UNUSED = ~0u;
+	std::vector<unsigned int> remap(vertices.size(), UNUSED);
+	std::vector<Vertex> ordered;
+	ordered.reserve(vertices.size());
+	for (unsigned int& index : indices)
+	{
+		if (remap[index] == UNUSED)
+		{
+			remap[index] = (unsigned int)ordered.size();
+			ordered.push_back(vertices[index]);
+		}
+		index = remap[index];
+	}
+	vertices = std::move(ordered);
+}
+
+MeshOptimizationReport optimizeMesh(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices)
+{
+	MeshOptimizationReport report;
+	report.verticesBefore = vertices.size();
+	report.before = analyzeVertexCache(indices, vertices.size());
+
+	if (indices.size() % 3 == 0)
+	{
+		deduplicateVertices(vertices, indices);
+		std::vector<size_t> clusters;
+		optimizeVertexCache(indices, vertices.size(), &clusters);
+		optimizeOverdraw(indices, vertices, clusters);
+		optimizeVertexFetch(vertices, indices);
+	}
+
+	report.verticesAfter = vertices.size();
+	report.after = analyzeVertexCache(indices, vertices.size());
+	return report;
+}
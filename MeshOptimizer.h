@@ -0,0 +1,47 @@
+#pragma once
+
+#include <vector>
+#include <cstddef>
+#include "Mesh.h"
+
+// post-transform cache size the reordering targets and the stats simulate
+constexpr unsigned int VERTEX_CACHE_SIZE = 16;
+
+// average cache miss ratio (misses per triangle) and average transformed
+// vertex ratio (misses per referenced vertex) of a simulated FIFO cache
+struct VertexCacheStats
+{
+	float acmr = 0.0f;
+	float atvr = 0.0f;
+};
+
+VertexCacheStats analyzeVertexCache(const std::vector<unsigned int>& indices, size_t vertexCount,
+	unsigned int cacheSize = VERTEX_CACHE_SIZE);
+
+// merges bitwise identical vertices and remaps the indices, returns the
+// number of vertices removed
+size_t deduplicateVertices(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices);
+
+// Tipsify triangle order (Sander et al. 2007); clusters receives the first
+// triangle of every run that starts after a cache-cold jump
+void optimizeVertexCache(std::vector<unsigned int>& indices, size_t vertexCount,
+	std::vector<size_t>* clusters = nullptr, unsigned int cacheSize = VERTEX_CACHE_SIZE);
+
+// sorts the clusters from optimizeVertexCache so outward facing ones,
+// likelier to occlude the rest, are drawn first
+void optimizeOverdraw(std::vector<unsigned int>& indices, const std::vector<Vertex>& vertices,
+	const std::vector<size_t>& clusters);
+
+// renumbers vertices in first use order and drops unreferenced ones
+void optimizeVertexFetch(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices);
+
+// all of the above in order, triangle lists only; no GL calls
+struct MeshOptimizationReport
+{
+	size_t verticesBefore = 0;
+	size_t verticesAfter = 0;
+	VertexCacheStats before;
+	VertexCacheStats after;
+};
+
+MeshOptimizationReport optimizeMesh(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices);
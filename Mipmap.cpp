@@ -0,0 +1,144 @@
+#include "Mipmap.h"
+#include <algorithm>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_IX86)
+#include <emmintrin.h>
+#define MIPMAP_SSE
+#endif
+
+constexpr int SRGB_ENCODE_STEPS = 4096;
+
+struct SrgbTables
+{
+	float decode[256];
+	unsigned char encode[SRGB_ENCODE_STEPS + 1];
+
+	SrgbTables()
+	{
+		for (int i = 0; i < 256; i++)
+		{
+			float c = i / 255.0f;
+			decode[i] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+		}
+		for (int i = 0; i <= SRGB_ENCODE_STEPS; i++)
+		{
+			float l = (float)i / SRGB_ENCODE_STEPS;
+			float c = l <= 0.0031308f ? l * 12.92f : 1.055f * std::pow(l, 1.0f / 2.4f) - 0.055f;
+			encode[i] = (unsigned char)std::lround(std::clamp(c, 0.0f, 1.0f) * 255.0f);
+		}
+	}
+};
+
+static const SrgbTables& srgbTables()
+{
+	static const SrgbTables tables;
+	return tables;
+}
+
+static bool isColour(int channel, int channels, bool srgb)
+{
+	// the last channel of 2 and 4 channel images is alpha
+	bool alpha = (channels == 2 || channels == 4) && channel == channels - 1;
+	return srgb && !alpha;
+}
+
+// averages 2x2 blocks of four-float texels, edges repeat the last row/column
+static void downsample(const float* source, int width, int height, float* target, int w, int h)
+{
+	for (int y = 0; y < h; y++)
+	{
+		const float* row0 = source + (size_t)std::min(2 * y, height - 1) * width * 4;
+		const float* row1 = source + (size_t)std::min(2 * y + 1, height - 1) * width * 4;
+		float* out = target + (size_t)y * w * 4;
+		for (int x = 0; x < w; x++)
+		{
+			int x0 = std::min(2 * x, width - 1) * 4, x1 = std::min(2 * x + 1, width - 1) * 4;
+#ifdef MIPMAP_SSE
+			__m128 sum = _mm_add_ps(_mm_add_ps(_mm_loadu_ps(row0 + x0), _mm_loadu_ps(row0 + x1)),
+				_mm_add_ps(_mm_loadu_ps(row1 + x0), _mm_loadu_ps(row1 + x1)));
+			_mm_storeu_ps(out + x * 4, _mm_mul_ps(sum, _mm_set1_ps(0.25f)));
+#else
+			for (int c = 0; c < 4; c++)
+				out[x * 4 + c] = (row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c]) * 0.25f;
+#endif
+		}
+	}
+}
+
+MipChain buildMipChain(const Image& image, bool srgb)
+{
+	MipChain chain;
+	if (!image.pixels)
+		return chain;
+	chain.channels = image.channels;
+	const SrgbTables& tables = srgbTables();
+
+	int width = image.width, height = image.height;
+	size_t offset = 0;
+	while (true)
+	{
+		chain.levels.push_back({ width, height, offset });
+		offset += (size_t)width * height * image.channels;
+		if (width == 1 && height == 1)
+			break;
+		width = std::max(1, width / 2);
+		height = std::max(1, height / 2);
+	}
+	chain.pixels.resize(offset);
+
+	const unsigned char* pixels = image.pixels.get();
+	size_t texels = (size_t)image.width * image.height;
+	std::copy(pixels, pixels + texels * image.channels, chain.pixels.begin());
+
+	// level 0 in linear float, padded to four channels
+	std::vector<float> current(texels * 4, 0.0f), next;
+	for (size_t i = 0; i < texels; i++)
+		for (int c = 0; c < image.channels; c++)
+		{
+			unsigned char value = pixels[i * image.channels + c];
+			current[i * 4 + c] = isColour(c, image.channels, srgb) ? tables.decode[value] : value / 255.0f;
+		}
+
+	for (size_t level = 1; level < chain.levels.size(); level++)
+	{
+		const MipChain::Level& previous = chain.levels[level - 1];
+		const MipChain::Level& target = chain.levels[level];
+		next.resize((size_t)target.width * target.height * 4);
+		downsample(current.data(), previous.width, previous.height, next.data(), target.width, target.height);
+
+		unsigned char* out = chain.pixels.data() + target.offset;
+		for (size_t i = 0; i < (size_t)target.width * target.height; i++)
+			for (int c = 0; c < image.channels; c++)
+			{
+				float value = std::clamp(next[i * 4 + c], 0.0f, 1.0f);
+				out[i * image.channels + c] = isColour(c, image.channels, srgb)
+					? tables.encode[(int)(value * SRGB_ENCODE_STEPS + 0.5f)]
+					: (unsigned char)(value * 255.0f + 0.5f);
+			}
+		std::swap(current, next);
+	}
+	return chain;
+}
+
+void uploadMipChain(unsigned int textureID, const MipChain& chain, StagingRing* staging)
+{
+	GLenum format = pixelFormat(chain.channels);
+	const MipChain::Level& base = chain.levels[0];
+
+	glBindTexture(GL_TEXTURE_2D, textureID);
+	glTexStorage2D(GL_TEXTURE_2D, (int)chain.levels.size(), internalFormat(chain.channels), base.width, base.height);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	for (int level = 0; level < (int)chain.levels.size(); level++)
+	{
+		const MipChain::Level& l = chain.levels[level];
+		const unsigned char* pixels = chain.pixels.data() + l.offset;
+		if (staging)
+			staging->uploadTexture(textureID, level, l.width, l.height, format, GL_UNSIGNED_BYTE, pixels, (size_t)l.width * l.height * chain.channels);
+		else
+			glTexSubImage2D(GL_TEXTURE_2D, level, 0, 0, l.width, l.height, format, GL_UNSIGNED_BYTE, pixels);
+	}
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+	setTextureSampling((int)chain.levels.size());
+}
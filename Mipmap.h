@@ -0,0 +1,30 @@
+#pragma once
+
+#include <glad/glad.h>
+#include "Image.h"
+#include "StagingRing.h"
+#include <vector>
+#include <cstddef>
+
+// Complete mip chain of an 8-bit image, levels stored back to back.
+struct MipChain
+{
+	struct Level
+	{
+		int width;
+		int height;
+		size_t offset;
+	};
+
+	int channels = 0;
+	std::vector<Level> levels;
+	std::vector<unsigned char> pixels;
+};
+
+// 2x2 box filter on four-wide float texels (SSE where available); with
+// srgb the colour channels are filtered in linear space, alpha never is.
+// No GL calls.
+MipChain buildMipChain(const Image& image, bool srgb);
+
+// uploads every level, needs the context thread
+void uploadMipChain(unsigned int textureID, const MipChain& chain, StagingRing* staging = nullptr);
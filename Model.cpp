@@ -1,46 +1,828 @@
 #define STB_IMAGE_IMPLEMENTATION
 #include "Model.h"
+#include "SkinningPass.h"
+#include "Hash.h"
+#include <charconv>
+
+// part of the cache key, bump MODEL_CACHE_VERSION when processing changes
+constexpr unsigned int IMPORT_FLAGS = aiProcess_Triangulate | aiProcess_GenSmoothNormals;
 
-unsigned int loadTextureFromFile(const char* path, const std::string& directory);
-unsigned int loadEmbeddedTexture(const aiTexture* data);
 inline glm::mat4 aiMatrix4x4ToGlm(const aiMatrix4x4* from);
 inline glm::mat4 aiMatrix3x3ToGlm(const aiMatrix3x3* from);
 
-Model::Model(const char* path)
+// async models may lose their last reference on the worker importing them,
+// ~Model needs the context, so they wait there for deleteRetired
+static std::mutex retired_mutex;
+static std::vector<Model*> retired_models;
+static std::atomic<unsigned int> imports_running{ 0 };
+
+// first called from loadAsync, which runs on the context thread
+static std::thread::id contextThread()
+{
+	static const std::thread::id id = std::this_thread::get_id();
+	return id;
+}
+
+Model::Model(const char* path, const ModelOptions& options)
+	:Model(path, options, false)
 {
+}
+
+Model::Model(std::string path, const ModelOptions& options, bool deferred)
+	:path(std::move(path)), options(options)
+{
+	// decided here because workers can't ask the context
+	if (!GLAD_GL_EXT_texture_compression_s3tc)
+		this->options.compressTextures = false;
 	start_time = std::chrono::steady_clock::now();
-	loadModel(path);
+	if (!deferred && import())
+		upload();
+}
+
+ModelHandle Model::loadAsync(const char* path, const ModelOptions& options)
+{
+	contextThread();
+	deleteRetired();
+	std::shared_ptr<Model> model(new Model(path, options, true), [](Model* model) {
+		if (std::this_thread::get_id() == contextThread())
+			delete model;
+		else
+		{
+			std::lock_guard<std::mutex> lock(retired_mutex);
+			retired_models.push_back(model);
+		}
+	});
+	// the job keeps the model alive if the handle is dropped mid-import
+	imports_running++;
+	ThreadPool::shared().submit([model]() mutable {
+		model->import();
+		model.reset();
+		imports_running--;
+	});
+	return ModelHandle(model);
+}
+
+void Model::deleteRetired(bool waitForImports)
+{
+	while (waitForImports && imports_running > 0)
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+	std::vector<Model*> models;
+	{
+		std::lock_guard<std::mutex> lock(retired_mutex);
+		models.swap(retired_models);
+	}
+	for (Model* model : models)
+		delete model;
+}
+
+std::unique_ptr<Model> Model::importOnly(const char* path, const ModelOptions& options)
+{
+	std::unique_ptr<Model> model(new Model(path, options, true));
+	if (!model->import())
+		return nullptr;
+	return model;
+}
+
+LoadState Model::state() const
+{
+	return load_state;
+}
+
+const Bounds& Model::bounds() const
+{
+	return model_bounds;
 }
 
 Model::~Model(){
+	// decodes still in flight may hold a cache reference
+	for (auto& pending : pending_textures)
+		if (pending.decoded.valid())
+		{
+			DecodedTexture decoded = pending.decoded.get();
+			if (decoded.texture)
+				TextureCache::shared().release(decoded.key);
+		}
+	for (uint64_t key : texture_array_keys)
+		TextureCache::shared().release(key);
+	for (auto& [path, key] : texture_keys)
+		TextureCache::shared().release(key);
 }
 
-void Model::Draw(Shader& shader)
+void Model::Draw(Shader& shader, int palette)
 {
-	if (animated)
-		shader.setBool("animated", true); // doesn't work yet
+	const MeshUniforms& uniforms = uniformsFor(shader);
 
-		for (auto& m : meshes)
-		m.Draw(shader, textured);
+	shader.use();
+	setBones(shader, uniforms, palette);
+
+	glBindVertexArray(VAO);
+	for (auto& m : meshes)
+		m.Draw(shader, uniforms, textured);
+}
+
+void Model::Submit(RenderQueue& queue, Shader& shader, const glm::mat4& transform, int palette)
+{
+	const MeshUniforms& uniforms = uniformsFor(shader);
+	bool skinned = animated && palette >= 0;
+
+	for (auto& m : meshes)
+		queue.submit({ &shader, &uniforms, &m, VAO, textured, skinned, transform, skinned ? palette : 0 });
+}
+
+unsigned int Model::DrawIndirect(Shader& shader, const glm::mat4& transform, int palette)
+{
+	return drawIndirect(shader, transform, palette, VAO);
+}
+
+void Model::SubmitSkinned(RenderQueue& queue, Shader& shader, const glm::mat4& transform, unsigned int vao)
+{
+	const MeshUniforms& uniforms = uniformsFor(shader);
+
+	for (auto& m : meshes)
+		queue.submit({ &shader, &uniforms, &m, vao, textured, false, transform, 0 });
 }
 
-void Model::loadModel(std::string path)
+unsigned int Model::DrawIndirectSkinned(Shader& shader, const glm::mat4& transform, unsigned int vao)
 {
-	scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_GenSmoothNormals);
+	return drawIndirect(shader, transform, -1, vao);
+}
+
+unsigned int Model::drawIndirect(Shader& shader, const glm::mat4& transform, int palette, unsigned int vao)
+{
+	const MeshUniforms& uniforms = uniformsFor(shader);
+
+	shader.use();
+	shader.setMat4(uniforms.model, transform);
+	setBones(shader, uniforms, palette);
+
+	glBindVertexArray(vao);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, MATERIAL_BUFFER_BINDING, materialBuffer);
+	if (quantizationBuffer)
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, QUANTIZATION_BUFFER_BINDING, quantizationBuffer);
+
+	for (auto& batch : batches)
+	{
+		unsigned int diffuseNr = 0;
+		unsigned int specularNr = 0;
+		for (unsigned int i = 0; i < batch.textures.size(); i++)
+		{
+			glActiveTexture(GL_TEXTURE0 + i);
+			const std::string& name = batch.textures[i].type;
+			if (name == "texture_diffuse" && diffuseNr < MAX_SAMPLERS_PER_TYPE)
+				shader.setInt(uniforms.texture_diffuse[diffuseNr++], i);
+			else if (name == "texture_specular" && specularNr < MAX_SAMPLERS_PER_TYPE)
+				shader.setInt(uniforms.texture_specular[specularNr++], i);
+			glBindTexture(GL_TEXTURE_2D_ARRAY, batch.textures[i].id);
+		}
+
+		shader.setInt(uniforms.drawOffset, batch.first);
+		glMultiDrawElementsIndirect(GL_TRIANGLES, batch.indexType,
+			(void*)(batch.first * sizeof(DrawElementsIndirectCommand)), batch.count, 0);
+	}
+	glActiveTexture(GL_TEXTURE0);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+	return (unsigned int)batches.size();
+}
+
+unsigned int Model::DrawInstanced(Shader& shader, const std::vector<glm::mat4>& transforms, int palette,
+	unsigned int palettes)
+{
+	if (transforms.empty())
+		return 0;
+
+	const MeshUniforms& uniforms = uniformsFor(shader);
+	uploadInstances(transforms);
+
+	shader.use();
+	setBones(shader, uniforms, palette, palettes);
+
+	glBindVertexArray(VAO);
+	for (auto& m : meshes)
+		m.Draw(shader, uniforms, textured, (GLsizei)transforms.size());
+
+	return (unsigned int)meshes.size();
+}
+
+void Model::uploadInstances(const std::vector<glm::mat4>& transforms)
+{
+	size_t size = transforms.size() * sizeof(glm::mat4);
+
+	if (!instanceBuffer)
+	{
+		instanceBuffer = GLBuffer::create();
+		glBindVertexArray(VAO);
+		glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+		for (unsigned int i = 0; i < 4; i++)
+		{
+			glEnableVertexAttribArray(5 + i);
+			glVertexAttribPointer(5 + i, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void*)(i * sizeof(glm::vec4)));
+			glVertexAttribDivisor(5 + i, 1);
+		}
+		glBindVertexArray(0);
+	}
+
+	uploadOrphaned(GL_ARRAY_BUFFER, instanceBuffer, instanceCapacity, transforms.data(), size);
+}
+
+// expects the shader to be in use, the palettes come from the buffer an
+// AnimationStage binds
+void Model::setBones(Shader& shader, const MeshUniforms& uniforms, int palette, unsigned int palettes)
+{
+	bool skinned = animated && palette >= 0;
+	shader.setBool(uniforms.animated, skinned);
+	if (skinned)
+	{
+		shader.setInt(uniforms.boneOffset, palette);
+		shader.setInt(uniforms.boneStride, (int)bones.size());
+		shader.setInt(uniforms.paletteCount, (int)palettes);
+	}
+}
+
+const MeshUniforms& Model::uniformsFor(const Shader& shader)
+{
+	auto uniforms = uniform_cache.find(shader.ID);
+	if (uniforms == uniform_cache.end())
+		uniforms = uniform_cache.emplace(shader.ID, MeshUniforms(shader)).first;
+	return uniforms->second;
+}
+
+bool Model::import()
+{
+	directory = path.substr(0, path.find_last_of('/'));
+
+	std::string cachePath = path + ".bake";
+	uint64_t sourceHash = 0;
+	if (options.useCache)
+	{
+		sourceHash = hashFile(path);
+		if (importCached(cachePath, sourceHash))
+		{
+			load_state = LoadState::Imported;
+			return true;
+		}
+	}
+
+	scene = importer.ReadFile(path, IMPORT_FLAGS);
 
 	if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode)
 	{
 		std::cout << "ASSIMP::" << importer.GetErrorString() << std::endl;
+		load_state = LoadState::Failed;
+		return false;
+	}
+
+	for (unsigned int i = 0; i < scene->mNumTextures; i++)
+	{
+		const aiTexture* texture = scene->mTextures[i];
+		if (texture->mHeight == 0)
+			embedded_textures.push_back({ reinterpret_cast<const unsigned char*>(texture->pcData), texture->mWidth });
+		else
+			embedded_textures.push_back({ nullptr, 0 });
+	}
+
+	// bones refer to nodes, so the hierarchy comes first
+	extractNodes(scene->mRootNode, -1);
+	processNode(scene->mRootNode);
+	if (scene->HasAnimations())
+		extractAnimations();
+
+	assignRanges();
+	for (auto& m : meshes)
+		growBounds(m.vertices.data(), m.vertices.size());
+	if (options.compactVertices)
+		quantizeMeshes(nullptr);
+
+	if (options.useCache)
+		writeModelCache(cachePath, sourceHash, IMPORT_FLAGS, meshes, embedded_textures, nodes, bones, animations);
+	// compression is lossy, the bake keeps the clips as imported
+	setupAnimation();
+	keepBindPose(nullptr);
+
+	load_state = LoadState::Imported;
+	return true;
+}
+
+bool Model::importCached(const std::string& cachePath, uint64_t sourceHash)
+{
+	if (!readModelCache(cachePath, sourceHash, IMPORT_FLAGS, bake))
+		return false;
+
+	embedded_textures = bake.embedded;
+	for (auto& cached : bake.meshes)
+	{
+		Mesh mesh({}, {}, std::move(cached.textures), cached.material);
+		mesh.baseVertex = cached.baseVertex;
+		mesh.indexOffset = cached.indexOffset;
+		mesh.indexType = cached.indexType;
+		mesh.indexCount = cached.indexCount;
+		loadTextures(mesh.textures);
+		meshes.push_back(std::move(mesh));
+	}
+	// readModelCache checked the base vertices are in order and in range,
+	// each mesh runs up to the next one
+	for (size_t i = 0; i < meshes.size(); i++)
+	{
+		size_t end = i + 1 < meshes.size() ? meshes[i + 1].baseVertex : bake.vertexCount;
+		meshes[i].vertexCount = (unsigned int)(end - meshes[i].baseVertex);
+	}
+	nodes = std::move(bake.nodes);
+	bones = std::move(bake.bones);
+	animations = std::move(bake.animations);
+	growBounds(bake.vertices, bake.vertexCount);
+	setupAnimation();
+	keepBindPose(bake.vertices);
+	if (options.compactVertices)
+		quantizeMeshes(bake.vertices);
+
+	from_cache = true;
+	return true;
+}
+
+void Model::upload()
+{
+	if (from_cache)
+	{
+		// straight from the mapping into the buffers, no parsing of the geometry
+		createBuffers(bake.vertexCount, bake.indexBytes);
+		if (options.compactVertices)
+			uploadRange(VBO, 0, compact_vertices.data(), compact_vertices.size() * sizeof(CompactVertex));
+		else
+			uploadRange(VBO, 0, bake.vertices, bake.vertexCount * sizeof(Vertex));
+		uploadRange(EBO, 0, bake.indices, bake.indexBytes);
+	}
+	else
+		setupBuffers();
+	finishTextures();
+	setupIndirect();
+	if (options.staging)
+		options.staging->fence();
+
+	embedded_textures.clear();
+	bake = ModelCache();
+	std::vector<CompactVertex>().swap(compact_vertices);
+
+	if (!options.keepCpuData)
+		for (auto& m : meshes)
+			m.releaseGeometry();
+
+	if (scene && options.freeScene)
+	{
+		size_t withScene = residentMemory();
+		importer.FreeScene();
+		scene = nullptr;
+		size_t withoutScene = residentMemory();
+		std::cout << path << ": resident " << withScene / (1024 * 1024) << " MB with the Assimp scene, "
+			<< withoutScene / (1024 * 1024) << " MB after freeing it" << std::endl;
+	}
+
+	load_state = LoadState::Uploaded;
+}
+
+void Model::growBounds(const Vertex* vertices, size_t count)
+{
+	if (count == 0)
 		return;
+	if (!has_bounds)
+		model_bounds.min = model_bounds.max = vertices[0].Position;
+	has_bounds = true;
+	for (size_t i = 0; i < count; i++)
+	{
+		model_bounds.min = glm::min(model_bounds.min, vertices[i].Position);
+		model_bounds.max = glm::max(model_bounds.max, vertices[i].Position);
 	}
+}
 
-	directory = path.substr(0, path.find_last_of('/'));
+// vertices is the model's whole vertex blob, null when the meshes still
+// hold their own; reports the worst error of every mesh
+void Model::quantizeMeshes(const Vertex* vertices)
+{
+	compact_vertices.resize(meshes.size() ? meshes.back().baseVertex + meshes.back().vertexCount : 0);
+	for (size_t i = 0; i < meshes.size(); i++)
+	{
+		Mesh& m = meshes[i];
+		const Vertex* source = vertices ? vertices + m.baseVertex : m.vertices.data();
+		QuantizationError error;
+		QuantizationBounds bounds = quantizeVertices(source, m.vertexCount, compact_vertices.data() + m.baseVertex, error);
+		m.positionOffset = bounds.offset;
+		m.positionScale = bounds.scale;
 
-	if (scene->HasAnimations()) {
-		//
+		float extent = std::max(bounds.scale.x, std::max(bounds.scale.y, bounds.scale.z));
+		std::cout << path << ": mesh " << i << " quantized, " << m.vertexCount << " vertices, max error position "
+			<< error.position << " (" << (extent > 0.0f ? 100.0f * error.position / extent : 0.0f) << "% of extent), normal "
+			<< error.normalDegrees << " deg, uv " << error.texCoord << std::endl;
 	}
+	std::cout << path << ": vertex data " << compact_vertices.size() * sizeof(Vertex) / 1024 << " KB -> "
+		<< compact_vertices.size() * sizeof(CompactVertex) / 1024 << " KB" << std::endl;
+}
 
-	processNode(scene->mRootNode);
+// Reduces and quantizes the clips into the clip set and reports per clip
+// what that saved and the largest joint position difference to sampling
+// the clips as imported, over 256 steps of the clip.
+void Model::setupAnimation()
+{
+	animated = !bones.empty() && !animations.empty();
+	if (bones.size() > MAX_BONES)
+	{
+		std::cout << path << ": " << bones.size() << " bones, more than the " << MAX_BONES
+			<< " the vertex formats support, drawing in bind pose" << std::endl;
+		animated = false;
+	}
+
+	if (!animated)
+		return;
+
+	KeyTolerance tolerance = options.animationTolerance;
+	float diagonal = has_bounds ? glm::length(model_bounds.max - model_bounds.min) : 0.0f;
+	if (diagonal > 0.0f)
+		tolerance.translation *= diagonal;
+	std::vector<AnimationClip> reduced = animations;
+	for (auto& clip : reduced)
+		reduceKeys(clip, tolerance);
+	clip_set = SoaClipSet(nodes, bones, reduced);
+
+	const unsigned int STEPS = 256;
+	AnimationSampler reference(nodes, bones, animations);
+	SimdSampler compressed(clip_set);
+	for (unsigned int c = 0; c < animations.size(); c++)
+	{
+		const AnimationClip& clip = animations[c];
+		float error = 0.0f;
+		for (unsigned int step = 0; step < STEPS; step++)
+		{
+			float seconds = clip.ticksPerSecond > 0.0f ? clip.duration * step / STEPS / clip.ticksPerSecond : 0.0f;
+			reference.evaluate(c, seconds);
+			compressed.evaluate(c, seconds);
+			for (size_t n = 0; n < nodes.size(); n++)
+				error = std::max(error, glm::distance(glm::vec3(reference.globalTransforms()[n][3]),
+					glm::vec3(compressed.globalTransforms()[n][3])));
+		}
+		std::cout << path << ": clip \"" << clip.name << "\" keys " << keyCount(clip) << " -> " << keyCount(reduced[c])
+			<< ", " << keyBytes(clip) / 1024 << " KB -> " << clip_set.clipBytes(c) / 1024
+			<< " KB, max joint error " << error << std::endl;
+	}
+
+	if (!options.keepRawAnimation)
+		std::vector<AnimationClip>().swap(animations);
+}
+
+// vertices null takes them from the meshes
+void Model::keepBindPose(const Vertex* vertices)
+{
+	if (!options.cpuSkinning || clip_set.clipCount() == 0 || meshes.empty())
+		return;
+
+	bind_pose.resize(meshes.back().baseVertex + meshes.back().vertexCount);
+	if (vertices)
+		std::copy(vertices, vertices + bind_pose.size(), bind_pose.begin());
+	else
+		for (auto& m : meshes)
+			std::copy(m.vertices.begin(), m.vertices.end(), bind_pose.begin() + m.baseVertex);
+}
+
+// keeps the WEIGHTS_PER_VERTEX strongest influences of every vertex
+void Model::extractBones(aiMesh* mesh, std::vector<Vertex>& vertices)
+{
+	for (unsigned int b = 0; b < mesh->mNumBones; b++)
+	{
+		const aiBone* bone = mesh->mBones[b];
+		auto found = bone_index.find(bone->mName.C_Str());
+		if (found == bone_index.end())
+		{
+			auto node = node_index.find(bone->mName.C_Str());
+			found = bone_index.emplace(bone->mName.C_Str(), (int)bones.size()).first;
+			bones.push_back({ node != node_index.end() ? node->second : 0, aiMatrix4x4ToGlm(&bone->mOffsetMatrix) });
+		}
+		int id = found->second;
+
+		for (unsigned int w = 0; w < bone->mNumWeights; w++)
+		{
+			const aiVertexWeight& weight = bone->mWeights[w];
+			Vertex& vertex = vertices[weight.mVertexId];
+			int weakest = 0;
+			for (int k = 1; k < WEIGHTS_PER_VERTEX; k++)
+				if (vertex.Weights[k] < vertex.Weights[weakest])
+					weakest = k;
+			if (weight.mWeight > vertex.Weights[weakest])
+			{
+				vertex.BoneIDs[weakest] = id;
+				vertex.Weights[weakest] = weight.mWeight;
+			}
+		}
+	}
+
+	if (mesh->mNumBones == 0)
+		return;
+	for (auto& vertex : vertices)
+	{
+		float total = 0.0f;
+		for (int k = 0; k < WEIGHTS_PER_VERTEX; k++)
+			total += vertex.Weights[k];
+		if (total > 0.0f)
+			for (int k = 0; k < WEIGHTS_PER_VERTEX; k++)
+				vertex.Weights[k] /= total;
+	}
+}
+
+unsigned int Model::boneCount() const
+{
+	return (unsigned int)bones.size();
+}
+
+const std::vector<SkeletonNode>& Model::skeleton() const
+{
+	return nodes;
+}
+
+const std::vector<Bone>& Model::skinBones() const
+{
+	return bones;
+}
+
+const std::vector<AnimationClip>& Model::clips() const
+{
+	return animations;
+}
+
+const SoaClipSet& Model::clipSet() const
+{
+	return clip_set;
+}
+
+const std::vector<Vertex>& Model::bindPose() const
+{
+	return bind_pose;
+}
+
+void Model::extractNodes(aiNode* node, int parent)
+{
+	int index = (int)nodes.size();
+	nodes.push_back({ node->mName.C_Str(), parent, aiMatrix4x4ToGlm(&node->mTransformation) });
+	node_index.emplace(nodes.back().name, index);
+	for (unsigned int i = 0; i < node->mNumChildren; i++)
+		extractNodes(node->mChildren[i], index);
+}
+
+void Model::extractAnimations()
+{
+	for (unsigned int a = 0; a < scene->mNumAnimations; a++)
+	{
+		const aiAnimation* animation = scene->mAnimations[a];
+		AnimationClip clip;
+		clip.name = animation->mName.C_Str();
+		clip.duration = (float)animation->mDuration;
+		clip.ticksPerSecond = animation->mTicksPerSecond != 0.0 ? (float)animation->mTicksPerSecond : 25.0f;
+
+		for (unsigned int c = 0; c < animation->mNumChannels; c++)
+		{
+			const aiNodeAnim* channel = animation->mChannels[c];
+			auto node = node_index.find(channel->mNodeName.C_Str());
+			if (node == node_index.end())
+				continue;
+
+			NodeAnimation track;
+			track.node = node->second;
+			track.positions.reserve(channel->mNumPositionKeys);
+			for (unsigned int k = 0; k < channel->mNumPositionKeys; k++)
+			{
+				const aiVectorKey& key = channel->mPositionKeys[k];
+				track.positions.push_back({ (float)key.mTime, glm::vec3(key.mValue.x, key.mValue.y, key.mValue.z) });
+			}
+			track.rotations.reserve(channel->mNumRotationKeys);
+			for (unsigned int k = 0; k < channel->mNumRotationKeys; k++)
+			{
+				const aiQuatKey& key = channel->mRotationKeys[k];
+				track.rotations.push_back({ (float)key.mTime, glm::quat(key.mValue.w, key.mValue.x, key.mValue.y, key.mValue.z) });
+			}
+			track.scales.reserve(channel->mNumScalingKeys);
+			for (unsigned int k = 0; k < channel->mNumScalingKeys; k++)
+			{
+				const aiVectorKey& key = channel->mScalingKeys[k];
+				track.scales.push_back({ (float)key.mTime, glm::vec3(key.mValue.x, key.mValue.y, key.mValue.z) });
+			}
+			clip.channels.push_back(std::move(track));
+		}
+		animations.push_back(std::move(clip));
+	}
+}
+
+// 32-bit index ranges go first so every range is aligned to its index size
+void Model::assignRanges()
+{
+	size_t vertexCount = 0, indexBytes = 0;
+	for (auto& m : meshes)
+	{
+		m.baseVertex = (unsigned int)vertexCount;
+		vertexCount += m.vertices.size();
+	}
+	for (GLenum type : { GL_UNSIGNED_INT, GL_UNSIGNED_SHORT })
+		for (auto& m : meshes)
+			if (m.indexType == type)
+			{
+				m.indexOffset = indexBytes;
+				indexBytes += m.indexCount * m.indexSize();
+			}
+
+	size_t shortMeshes = std::count_if(meshes.begin(), meshes.end(), [](const Mesh& m) { return m.indexType == GL_UNSIGNED_SHORT; });
+	size_t indexCount = 0;
+	for (auto& m : meshes)
+		indexCount += m.indexCount;
+	std::cout << path << ": " << shortMeshes << " of " << meshes.size() << " meshes use 16-bit indices, "
+		<< indexBytes / 1024 << " KB of indices instead of " << indexCount * sizeof(unsigned int) / 1024 << " KB" << std::endl;
+}
+
+void Model::setupBuffers()
+{
+	size_t vertexCount = 0, indexBytes = 0;
+	for (auto& m : meshes)
+	{
+		vertexCount += m.vertices.size();
+		indexBytes += m.indexCount * m.indexSize();
+	}
+
+	createBuffers(vertexCount, indexBytes);
+
+	if (options.compactVertices)
+		uploadRange(VBO, 0, compact_vertices.data(), compact_vertices.size() * sizeof(CompactVertex));
+	for (auto& m : meshes)
+	{
+		if (!options.compactVertices)
+			uploadRange(VBO, m.baseVertex * sizeof(Vertex), m.vertices.data(), m.vertices.size() * sizeof(Vertex));
+		uploadRange(EBO, m.indexOffset, m.indexData(), m.indexCount * m.indexSize());
+	}
+}
+
+void Model::uploadRange(unsigned int buffer, size_t offset, const void* data, size_t size)
+{
+	if (options.staging)
+	{
+		options.staging->uploadBuffer(buffer, offset, data, size);
+		return;
+	}
+	glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+	glBufferSubData(GL_COPY_WRITE_BUFFER, offset, size, data);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+// with a staging ring the storage is immutable and only written by copies
+void Model::createBuffers(size_t vertexCount, size_t indexBytes)
+{
+	VBO = GLBuffer::create();
+	EBO = GLBuffer::create();
+	VAO = GLVertexArray::create();
+
+	glBindVertexArray(VAO);
+
+	size_t stride = options.compactVertices ? sizeof(CompactVertex) : sizeof(Vertex);
+
+	glBindBuffer(GL_ARRAY_BUFFER, VBO);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+	if (options.staging)
+	{
+		glBufferStorage(GL_ARRAY_BUFFER, vertexCount * stride, nullptr, 0);
+		glBufferStorage(GL_ELEMENT_ARRAY_BUFFER, indexBytes, nullptr, 0);
+	}
+	else
+	{
+		glBufferData(GL_ARRAY_BUFFER, vertexCount * stride, nullptr, GL_STATIC_DRAW);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexBytes, nullptr, GL_STATIC_DRAW);
+	}
+
+	glEnableVertexAttribArray(0);
+	glEnableVertexAttribArray(1);
+	glEnableVertexAttribArray(2);
+	glEnableVertexAttribArray(3);
+	glEnableVertexAttribArray(4);
+	if (options.compactVertices)
+	{
+		glVertexAttribPointer(0, 4, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(CompactVertex), (void*)offsetof(CompactVertex, position));
+		glVertexAttribPointer(1, 2, GL_SHORT, GL_TRUE, sizeof(CompactVertex), (void*)offsetof(CompactVertex, normal));
+		glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, sizeof(CompactVertex), (void*)offsetof(CompactVertex, texCoords));
+		glVertexAttribIPointer(3, 4, GL_UNSIGNED_BYTE, sizeof(CompactVertex), (void*)offsetof(CompactVertex, boneIDs));
+		glVertexAttribPointer(4, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(CompactVertex), (void*)offsetof(CompactVertex, weights));
+	}
+	else
+	{
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
+		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
+		glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
+		glVertexAttribIPointer(3, 4, GL_INT, sizeof(Vertex), (void*)offsetof(Vertex, BoneIDs));
+		glVertexAttribPointer(4, 4, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Weights));
+	}
+
+	glBindVertexArray(0);
+}
+
+GLVertexArray Model::createSkinnedVertexArray(unsigned int skinned) const
+{
+	GLVertexArray vao = GLVertexArray::create();
+	glBindVertexArray(vao);
+
+	glBindBuffer(GL_ARRAY_BUFFER, skinned);
+	glEnableVertexAttribArray(0);
+	glEnableVertexAttribArray(1);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(SkinnedVertex), (void*)offsetof(SkinnedVertex, position));
+	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(SkinnedVertex), (void*)offsetof(SkinnedVertex, normal));
+
+	glBindBuffer(GL_ARRAY_BUFFER, VBO);
+	glEnableVertexAttribArray(2);
+	if (options.compactVertices)
+		glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, sizeof(CompactVertex), (void*)offsetof(CompactVertex, texCoords));
+	else
+		glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+
+	glBindVertexArray(0);
+	return vao;
+}
+
+static bool sameTextures(const std::vector<Texture>& a, const std::vector<Texture>& b)
+{
+	return std::equal(a.begin(), a.end(), b.begin(), b.end(),
+		[](const Texture& x, const Texture& y) { return x.id == y.id && x.type == y.type; });
+}
+
+void Model::setupIndirect()
+{
+	static const std::vector<Texture> untextured;
+	auto texturesOf = [&](const Mesh& m) -> const std::vector<Texture>& {
+		return textured ? m.textures : untextured;
+	};
+
+	std::vector<unsigned int> order(meshes.size());
+	for (unsigned int i = 0; i < order.size(); i++)
+		order[i] = i;
+	std::stable_sort(order.begin(), order.end(), [&](unsigned int a, unsigned int b) {
+		if (meshes[a].indexType != meshes[b].indexType)
+			return meshes[a].indexType < meshes[b].indexType;
+		const std::vector<Texture>& ta = texturesOf(meshes[a]);
+		const std::vector<Texture>& tb = texturesOf(meshes[b]);
+		return std::lexicographical_compare(ta.begin(), ta.end(), tb.begin(), tb.end(),
+			[](const Texture& x, const Texture& y) { return x.id < y.id; });
+	});
+
+	// with bindless handles in the materials nothing is bound per batch and
+	// there is one batch per index type
+	bool bindless = bindlessDraws();
+
+	std::vector<DrawElementsIndirectCommand> commands;
+	std::vector<DrawMaterial> materials;
+	std::vector<DrawQuantization> quantizations;
+	batches.clear();
+	for (unsigned int i : order)
+	{
+		const Mesh& m = meshes[i];
+		const std::vector<Texture>& textures = bindless ? untextured : texturesOf(m);
+		if (batches.empty() || batches.back().indexType != m.indexType || !sameTextures(batches.back().textures, textures))
+			batches.push_back({ m.indexType, textures, (unsigned int)commands.size(), 0 });
+		batches.back().count++;
+
+		const Texture* diffuse = nullptr;
+		const Texture* specular = nullptr;
+		for (auto& texture : m.textures)
+		{
+			if (texture.type == "texture_diffuse" && !diffuse)
+				diffuse = &texture;
+			else if (texture.type == "texture_specular" && !specular)
+				specular = &texture;
+		}
+		uint64_t diffuseMap = diffuse ? diffuse->handle : 0;
+		uint64_t specularMap = specular ? specular->handle : 0;
+
+		// firstIndex counts in units of the batch's index type
+		commands.push_back({ m.indexCount, 1, (unsigned int)(m.indexOffset / m.indexSize()), (int)m.baseVertex, 0 });
+		quantizations.push_back({ glm::vec4(m.positionOffset, 0.0f), glm::vec4(m.positionScale, 0.0f) });
+		materials.push_back({
+			glm::vec4(m.material.ambient, 1.0f),
+			glm::vec4(m.material.diffuse, 1.0f),
+			glm::vec4(m.material.specular, 1.0f),
+			diffuseMap,
+			specularMap,
+			m.material.shininess,
+			textured && (bindless ? diffuseMap != 0 : !m.textures.empty()),
+			diffuse ? diffuse->layer : 0,
+			specular ? specular->layer : 0
+		});
+	}
+
+	indirectBuffer = GLBuffer::create();
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBuffer);
+	glBufferData(GL_DRAW_INDIRECT_BUFFER, commands.size() * sizeof(DrawElementsIndirectCommand), commands.data(), GL_STATIC_DRAW);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+	materialBuffer = GLBuffer::create();
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, materialBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, materials.size() * sizeof(DrawMaterial), materials.data(), GL_STATIC_DRAW);
+
+	if (options.compactVertices)
+	{
+		quantizationBuffer = GLBuffer::create();
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, quantizationBuffer);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, quantizations.size() * sizeof(DrawQuantization), quantizations.data(), GL_STATIC_DRAW);
+	}
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
 }
 
 void Model::processNode(aiNode* node)
@@ -49,6 +831,8 @@ void Model::processNode(aiNode* node)
 	{
 		aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
 		meshes.push_back(processMesh(mesh));
+		// decodes start now and overlap the rest of the traversal
+		loadTextures(meshes.back().textures);
 	}
 	for (unsigned int i = 0; i < node->mNumChildren; i++)
 	{
@@ -63,6 +847,8 @@ Mesh Model::processMesh(aiMesh* mesh)
 
 	Material mesh_material;
 
+	vertices.reserve(mesh->mNumVertices);
+	indices.reserve(mesh->mNumFaces * 3);
 	for (unsigned int i = 0; i < mesh->mNumVertices; i++)
 	{
 		Vertex vertex;
@@ -91,11 +877,21 @@ Mesh Model::processMesh(aiMesh* mesh)
 
 	for (unsigned int i = 0; i < mesh->mNumFaces; i++)
 	{
-		auto face = std::make_unique<aiFace>(mesh->mFaces[i]);
-		for (unsigned int j = 0; j < face->mNumIndices; j++)
-			indices.push_back(face->mIndices[j]);
+		// points and lines left over after triangulation can't be drawn as triangles
+		const aiFace& face = mesh->mFaces[i];
+		if (face.mNumIndices != 3)
+			continue;
+		for (unsigned int j = 0; j < face.mNumIndices; j++)
+			indices.push_back(face.mIndices[j]);
 	}
 
+	extractBones(mesh, vertices);
+
+	MeshOptimizationReport report = optimizeMesh(vertices, indices);
+	std::cout << path << ": mesh \"" << mesh->mName.C_Str() << "\" " << report.verticesBefore << " -> " << report.verticesAfter
+		<< " vertices, ACMR " << report.before.acmr << " -> " << report.after.acmr
+		<< ", ATVR " << report.before.atvr << " -> " << report.after.atvr << std::endl;
+
 	if (mesh->mMaterialIndex >= 0)
 	{
 		aiMaterial *material = scene->mMaterials[mesh->mMaterialIndex];
@@ -106,7 +902,9 @@ Mesh Model::processMesh(aiMesh* mesh)
 		textures.insert(textures.end(), specularMaps.begin(), specularMaps.end());
 	}
 
-	return Mesh(vertices, indices, textures, mesh_material);
+	Mesh result(std::move(vertices), std::move(indices), std::move(textures), mesh_material);
+	result.narrowIndices();
+	return result;
 }
 
 Material Model::loadMaterial(aiMaterial* mat)
@@ -126,6 +924,8 @@ Material Model::loadMaterial(aiMaterial* mat)
 	return material;
 }
 
+// resolves the texture references of a material, embedded textures are
+// named "*<index>" like Assimp does; GL textures are made in loadTextures
 std::vector<Texture> Model::loadMaterialTextures(aiMaterial* mat, aiTextureType type, std::string typeName)
 {
 	std::vector<Texture> textures;
@@ -134,113 +934,298 @@ std::vector<Texture> Model::loadMaterialTextures(aiMaterial* mat, aiTextureType
 		aiString texture_path;
 		mat->GetTexture(type, i, &texture_path);
 		auto embedded = scene->GetEmbeddedTexture(texture_path.C_Str());
-		if (embedded) {
-			texture_path.Clear();
-		}
-		if (std::find_if(textures_loaded.begin(), textures_loaded.end(), [&](Texture const& t) {
-			{return t.path == texture_path.C_Str(); }
-			}) != textures_loaded.end()
-			)
-		{
-			continue;
-		}
-		if (texture_path.length == 0
-			|| std::filesystem::exists(texture_path.C_Str())
-			|| std::filesystem::exists(directory + '/' + texture_path.C_Str())
-			)
-		{
+
 		Texture texture;
-		if (texture_path.length == 0)
+		texture.id = 0;
+		texture.type = typeName;
+		if (embedded)
 		{
-			texture.id = loadEmbeddedTexture(embedded);
-			texture.path = "E";
+			unsigned int index = 0;
+			while (index < scene->mNumTextures && scene->mTextures[index] != embedded)
+				index++;
+			texture.path = "*" + std::to_string(index);
 		}
-		else {
-			texture.id = loadTextureFromFile(texture_path.C_Str(), this->directory);
+		else if (std::filesystem::exists(texture_path.C_Str())
+			|| std::filesystem::exists(directory + '/' + texture_path.C_Str()))
+		{
 			texture.path = texture_path.C_Str();
 		}
-		texture.type = typeName;
-		textures.push_back(texture);
-		textures_loaded.push_back(texture);
-		}
 		else {
 			std::cout << "Texture \"" << texture_path.C_Str() << "\" of type " 
 				<< typeName <<" index " << i << " is unavailable." << std::endl;
-		}	
+			continue;
+		}
+		textures.push_back(texture);
 	}
 
-	if (!textures.empty())
-		textured = true;
-
 	return textures;
 }
 
-unsigned int loadTextureFromFile(const char* path, const std::string& directory)
+// queues a hash + decode on the shared pool for every texture not seen yet,
+// the decode is skipped if the TextureCache already has the contents; GL
+// textures are resolved and the meshes patched in finishTextures
+void Model::loadTextures(std::vector<Texture>& textures)
 {
-	std::string filename = std::string(path);
-	filename = directory + '/' + filename;
+	if (!options.loadTextures)
+		return;
+	for (auto& texture : textures)
+	{
+		if (!textures_loaded.emplace(texture.path, texture).second)
+			continue;
 
-	unsigned int textureID;
-	glGenTextures(1, &textureID);
+		TextureDecodeOptions decode;
+		decode.compress = options.compressTextures;
+		decode.cpuMipmaps = options.cpuMipmaps;
+		decode.srgb = texture.type == "texture_diffuse";
 
-	int width, height, nrComponents;
-	unsigned char* data = stbi_load(filename.c_str(), &width, &height, &nrComponents, 0);
-	if (data)
-	{
-		GLenum format;
-		if (nrComponents == 1)
-			format = GL_RED;
-		else if (nrComponents == 3)
-			format = GL_RGB;
-		else if (nrComponents == 4)
-			format = GL_RGBA;
+		if (texture.path[0] == '*')
+		{
+			size_t embeddedIndex = 0;
+			const char* last = texture.path.data() + texture.path.size();
+			auto parsed = std::from_chars(texture.path.data() + 1, last, embeddedIndex);
+			if (parsed.ec != std::errc() || parsed.ptr != last)
+			{
+				std::cout << "Invalid embedded texture reference \"" << texture.path << "\"." << std::endl;
+				continue;
+			}
+			if (embeddedIndex >= embedded_textures.size() || embedded_textures[embeddedIndex].size == 0)
+			{
+				std::cout << "not yet." << std::endl;
+				continue;
+			}
+			EmbeddedTexture embedded = embedded_textures[embeddedIndex];
+			pending_textures.push_back({ texture.path, ThreadPool::shared().submit([embedded, decode]() {
+				return decodeTextureMemory(embedded.data, embedded.size, decode);
+				}) });
+		}
+		else
+		{
+			std::string filename = directory + '/' + texture.path;
+			pending_textures.push_back({ texture.path, ThreadPool::shared().submit([filename, decode]() {
+				return decodeTextureFile(filename, decode);
+				}) });
+		}
+	}
 
-		glBindTexture(GL_TEXTURE_2D, textureID);
-		glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-		glGenerateMipmap(GL_TEXTURE_2D);
+	if (!textures.empty())
+		textured = true;
+}
 
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+bool Model::texturesDecoded() const
+{
+	for (auto& pending : pending_textures)
+		if (pending.decoded.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+			return false;
+	return true;
+}
 
-		stbi_image_free(data);
-	}
-	else
+// uploads decodes in the order they complete, must run on the context thread
+// before the aiScene or the mapped cache the embedded data points into goes away
+void Model::finishTextures()
+{
+	TextureCache& cache = TextureCache::shared();
+	auto begin = std::chrono::steady_clock::now();
+	size_t count = pending_textures.size();
+	// by key, what the textures uploaded here would take without BCn
+	std::unordered_map<uint64_t, size_t> uncompressedBytes;
+
+	while (!pending_textures.empty())
 	{
-		std::cout << "stbi_image loading failed. cannot find texture associated with file." << std::endl;
-		stbi_image_free(data);
+		bool uploaded = false;
+		for (size_t i = 0; i < pending_textures.size();)
+		{
+			auto& pending = pending_textures[i];
+			if (pending.decoded.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+			{
+				i++;
+				continue;
+			}
+
+			Texture& texture = textures_loaded[pending.path];
+			DecodedTexture decoded = pending.decoded.get();
+			if (decoded.key)
+			{
+				// pinned by the worker, or uploaded by another model while this one decoded
+				texture.id = decoded.texture ? decoded.texture : cache.acquire(decoded.key);
+				if (!texture.id && decoded.compressed.format)
+				{
+					const CompressedImage& image = decoded.compressed;
+					GLTexture object = GLTexture::create();
+					uploadCompressedTexture(object, image, options.staging);
+					texture.id = cache.insert(decoded.key, std::move(object), image.byteSize());
+					size_t base = (size_t)image.levels[0].width * image.levels[0].height * formatChannels(image.format);
+					uncompressedBytes[decoded.key] = base * 4 / 3;
+				}
+				else if (!texture.id && !decoded.mips.levels.empty())
+				{
+					const MipChain& mips = decoded.mips;
+					GLTexture object = GLTexture::create();
+					uploadMipChain(object, mips, options.staging);
+					texture.id = cache.insert(decoded.key, std::move(object), mips.pixels.size());
+					uncompressedBytes[decoded.key] = mips.pixels.size();
+				}
+				else if (!texture.id && decoded.image.pixels)
+				{
+					const Image& image = decoded.image;
+					GLTexture object = GLTexture::create();
+					uploadTexture(object, image, options.staging);
+					size_t bytes = (size_t)image.width * image.height * image.channels * 4 / 3;
+					texture.id = cache.insert(decoded.key, std::move(object), bytes);
+					uncompressedBytes[decoded.key] = bytes;
+				}
+				if (texture.id)
+				{
+					texture.handle = cache.handle(decoded.key);
+					texture_keys.emplace(texture.path, decoded.key);
+				}
+			}
+			if (!texture.id)
+				std::cout << "stbi_image loading failed. cannot find texture associated with file. (" << texture.path << ")" << std::endl;
+
+			if (i + 1 != pending_textures.size())
+				pending_textures[i] = std::move(pending_textures.back());
+			pending_textures.pop_back();
+			uploaded = true;
+		}
+		if (!uploaded)
+			pending_textures.front().decoded.wait_for(std::chrono::milliseconds(1));
 	}
 
-	return textureID;
+	packTextures(uncompressedBytes);
+	for (auto& m : meshes)
+		for (auto& texture : m.textures)
+		{
+			const Texture& loaded = textures_loaded[texture.path];
+			texture.id = loaded.id;
+			texture.layer = loaded.layer;
+			texture.handle = loaded.handle;
+		}
+
+	if (count)
+		std::cout << count << " textures decoded on " << ThreadPool::shared().size() << " threads in "
+			<< std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - begin).count()
+			<< " ms after import; texture cache " << cache.hits() << " hits, " << cache.misses() << " misses, "
+			<< cache.bytesSaved() / 1024 << " KB saved" << std::endl;
+	if (texture_bytes)
+		std::cout << path << ": texture memory " << texture_bytes / 1024 << " KB, "
+			<< texture_bytes_uncompressed / 1024 << " KB uncompressed" << std::endl;
 }
 
-unsigned int loadEmbeddedTexture(const aiTexture* emb_texture)
+// Turns every texture of the model into a GL_TEXTURE_2D_ARRAY so draws only
+// differ in the layer. Textures up to MAX_PACKED_TEXTURE_SIZE that share
+// format, size and level count are copied into the layers of one array; the
+// rest become single-layer views of their storage. The arrays live in the
+// TextureCache keyed by their members, so models packing the same textures
+// share them, and the 2D originals are released once packed.
+void Model::packTextures(const std::unordered_map<uint64_t, size_t>& uncompressedBytes)
 {
-	unsigned int textureID;
-	glGenTextures(1, &textureID);
-	if (emb_texture->mHeight == 0)
+	struct Layout
 	{
-		GLenum format = GL_RGB;
+		GLint format, width, height, levels;
+		bool operator==(const Layout& other) const
+		{
+			return format == other.format && width == other.width && height == other.height && levels == other.levels;
+		}
+	};
+	struct Group
+	{
+		Layout layout;
+		std::vector<uint64_t> keys;
+	};
+	TextureCache& cache = TextureCache::shared();
 
-		int width, height, nrComponents;
-		unsigned char* image = stbi_load_from_memory((unsigned char*)emb_texture->pcData, emb_texture->mWidth, &width, &height, &nrComponents, 0);
+	// paths with the same contents share a layer
+	std::unordered_map<uint64_t, std::vector<Texture*>> users;
+	std::vector<Group> groups;
+	for (auto& [path, texture] : textures_loaded)
+	{
+		auto key = texture_keys.find(path);
+		if (!texture.id || key == texture_keys.end())
+			continue;
+		std::vector<Texture*>& textures = users[key->second];
+		textures.push_back(&texture);
+		if (textures.size() > 1)
+			continue;
 
-		glBindTexture(GL_TEXTURE_2D, textureID);
-		glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, image);
-		glGenerateMipmap(GL_TEXTURE_2D);
+		Layout layout;
+		glBindTexture(GL_TEXTURE_2D, texture.id);
+		glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_INTERNAL_FORMAT, &layout.format);
+		glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &layout.width);
+		glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &layout.height);
+		glGetTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_IMMUTABLE_LEVELS, &layout.levels);
 
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-		
+		bool small = layout.width <= MAX_PACKED_TEXTURE_SIZE && layout.height <= MAX_PACKED_TEXTURE_SIZE;
+		auto group = std::find_if(groups.begin(), groups.end(), [&](const Group& g) { return g.layout == layout; });
+		if (small && group != groups.end())
+			group->keys.push_back(key->second);
+		else
+			groups.push_back({ layout, { key->second } });
 	}
-	else {
-		std::cout << "not yet." << std::endl;
+
+	for (auto& [layout, keys] : groups)
+	{
+		// the same members give the same array whatever order they loaded in
+		std::sort(keys.begin(), keys.end());
+		static const char ARRAY_TAG[] = "texture array";
+		uint64_t arrayKey = fnv1a(keys.data(), keys.size() * sizeof(uint64_t), fnv1a(ARRAY_TAG, sizeof(ARRAY_TAG)));
+
+		unsigned int id = cache.acquire(arrayKey);
+		if (!id)
+		{
+			GLTexture array = GLTexture::create();
+			size_t bytes = 0;
+			if (keys.size() == 1)
+			{
+				glTextureView(array, GL_TEXTURE_2D_ARRAY, users[keys[0]][0]->id, layout.format, 0, layout.levels, 0, 1);
+				glBindTexture(GL_TEXTURE_2D_ARRAY, array);
+			}
+			else
+			{
+				glBindTexture(GL_TEXTURE_2D_ARRAY, array);
+				glTexStorage3D(GL_TEXTURE_2D_ARRAY, layout.levels, layout.format, layout.width, layout.height, (GLsizei)keys.size());
+				for (int layer = 0; layer < (int)keys.size(); layer++)
+				{
+					int width = layout.width, height = layout.height;
+					for (int level = 0; level < layout.levels; level++)
+					{
+						glCopyImageSubData(users[keys[layer]][0]->id, GL_TEXTURE_2D, level, 0, 0, 0,
+							array, GL_TEXTURE_2D_ARRAY, level, 0, 0, layer, width, height, 1);
+						width = std::max(1, width / 2);
+						height = std::max(1, height / 2);
+					}
+				}
+			}
+			setTextureSampling(layout.levels, GL_TEXTURE_2D_ARRAY);
+
+			for (uint64_t key : keys)
+			{
+				bytes += cache.bytes(key);
+				auto uncompressed = uncompressedBytes.find(key);
+				texture_bytes_uncompressed += uncompressed != uncompressedBytes.end() ? uncompressed->second : cache.bytes(key);
+			}
+			texture_bytes += bytes;
+			id = cache.insert(arrayKey, std::move(array), bytes);
+		}
+		texture_array_keys.push_back(arrayKey);
+
+		uint64_t handle = cache.handle(arrayKey);
+		for (int layer = 0; layer < (int)keys.size(); layer++)
+			for (Texture* texture : users[keys[layer]])
+			{
+				texture->id = id;
+				texture->layer = layer;
+				texture->handle = handle;
+			}
 	}
 
-	return textureID;
+	// views keep the storage of their original alive
+	for (auto& [path, key] : texture_keys)
+		cache.release(key);
+	texture_keys.clear();
+
+	if (!users.empty())
+		std::cout << path << ": " << users.size() << " textures packed into "
+			<< groups.size() << " array textures" << std::endl;
 }
 
 inline glm::mat4 aiMatrix4x4ToGlm(const aiMatrix4x4* from)
@@ -264,4 +1249,43 @@ inline glm::mat4 aiMatrix3x3ToGlm(const aiMatrix3x3* from)
 	to[2][0] = (GLfloat)from->a3; to[2][1] = (GLfloat)from->b3;  to[2][2] = (GLfloat)from->c3;
 
 	return to;
-}
\ No newline at end of file
+}
+
+ModelHandle::ModelHandle(std::shared_ptr<Model> model)
+	:model(std::move(model))
+{
+}
+
+LoadState ModelHandle::state() const
+{
+	return model ? model->state() : LoadState::Failed;
+}
+
+bool ModelHandle::ready() const
+{
+	return state() == LoadState::Uploaded;
+}
+
+bool ModelHandle::poll()
+{
+	Model::deleteRetired();
+	if (state() == LoadState::Imported && model->texturesDecoded())
+		model->upload();
+	return ready();
+}
+
+const Bounds& ModelHandle::bounds() const
+{
+	static const Bounds empty;
+	return state() == LoadState::Imported || ready() ? model->bounds() : empty;
+}
+
+Model& ModelHandle::operator*() const
+{
+	return *model;
+}
+
+Model* ModelHandle::operator->() const
+{
+	return model.get();
+}
@@ -2,6 +2,19 @@
 
 #include "Shader.h"
 #include "Mesh.h"
+#include "RenderQueue.h"
+#include "GLHandle.h"
+#include "Animation.h"
+#include "Memory.h"
+#include "ModelCache.h"
+#include "Image.h"
+#include "TextureCache.h"
+#include "ThreadPool.h"
+#include "StagingRing.h"
+#include "VertexQuantization.h"
+#include "MeshOptimizer.h"
+#include "SimdSampler.h"
+#include "AnimationCompression.h"
 #include "stb_image.h"
 #include <vector>
 #include <unordered_map>
@@ -10,33 +23,242 @@
 #include <assimp/postprocess.h>
 #include <filesystem>
 #include <chrono>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
 
 #define GLM_ENABLE_EXPERIMENTAL
 #include <glm/gtx/string_cast.hpp>
 #include <glm/ext.hpp>
 
-constexpr auto WEIGHTS_PER_VERTEX = 4;
+// textures up to this size with matching format share an array texture
+constexpr int MAX_PACKED_TEXTURE_SIZE = 1024;
+
+struct ModelOptions
+{
+	// keep Mesh::vertices / Mesh::indices around after the GPU upload
+	bool keepCpuData = false;
+	// convert everything into engine structures and release the Assimp
+	// scene right after import instead of keeping it for the model's lifetime
+	bool freeScene = true;
+	// load from / write to the baked cache next to the source file
+	bool useCache = true;
+	// upload geometry and textures through this ring instead of
+	// glBufferData / glTexImage2D, has to outlive the upload
+	StagingRing* staging = nullptr;
+	// transcode textures to BC1/BC3/BC4/BC5 with a CPU encoder, cached in
+	// TEXTURE_CACHE_DIR; ignored without EXT_texture_compression_s3tc
+	bool compressTextures = true;
+	// build uncompressed mip chains on the import pool, sRGB-correct for
+	// diffuse maps, instead of glGenerateMipmap at upload
+	bool cpuMipmaps = true;
+	// upload CompactVertex instead of Vertex, the shaders drawing the model
+	// then have to be built with COMPACT_VERTEX
+	bool compactVertices = false;
+	// decode the material textures; without them an import needs no GL
+	// context, e.g. for importOnly in tools and benchmarks
+	bool loadTextures = true;
+	// key reduction tolerance, translation as a fraction of the bounds
+	// diagonal since skeletons come in any unit
+	KeyTolerance animationTolerance = { 1e-4f, 1e-3f, 1e-4f };
+	// keep the clips as imported after compressing them into the clip set,
+	// clips() is empty otherwise
+	bool keepRawAnimation = false;
+	// keep a copy of a skinned model's bind pose for SkinningPass's CPU path
+	bool cpuSkinning = false;
+};
+
+enum class LoadState
+{
+	Queued,
+	Imported,
+	Uploaded,
+	Failed
+};
+
+// axis-aligned box around all vertices in model space
+struct Bounds
+{
+	glm::vec3 min = glm::vec3(0.0f);
+	glm::vec3 max = glm::vec3(0.0f);
+};
+
+class ModelHandle;
 
 class Model
 {
 public:
-	Model(const char* path);
+	// blocks until the model is imported and uploaded
+	Model(const char* path, const ModelOptions& options = {});
+	// imports on the shared pool, the handle uploads once that is done
+	static ModelHandle loadAsync(const char* path, const ModelOptions& options = {});
+	// CPU side only on the calling thread, the model can't be drawn; null
+	// if the import failed
+	static std::unique_ptr<Model> importOnly(const char* path, const ModelOptions& options = {});
+	Model(const Model&) = delete;
+	Model& operator=(const Model&) = delete;
 	~Model();
-	void Draw(Shader& shader);
+	// palette is the model's first bone matrix in the AnimationStage buffer,
+	// -1 draws the bind pose
+	void Draw(Shader& shader, int palette = -1);
+	void Submit(RenderQueue& queue, Shader& shader, const glm::mat4& transform, int palette = -1);
+	// one glMultiDrawElementsIndirect per index type and texture set, the
+	// shader has to be built with MULTI_DRAW; with bindlessDraws() it is
+	// one call per index type without texture binds and the shader also
+	// needs BINDLESS; returns the number of draw calls issued
+	unsigned int DrawIndirect(Shader& shader, const glm::mat4& transform, int palette = -1);
+	// one instanced draw per sub-mesh, the shader has to be built with
+	// INSTANCED; instance i is skinned with palette number i % palettes of
+	// those stored back to back from palette on; returns the number of
+	// draw calls issued
+	unsigned int DrawInstanced(Shader& shader, const std::vector<glm::mat4>& transforms, int palette = -1,
+		unsigned int palettes = 1);
+	// draw the vertices a SkinningPass skinned for one character of this
+	// model as static geometry, vao is what SkinningPass::add returned;
+	// the shaders must be built without COMPACT_VERTEX
+	void SubmitSkinned(RenderQueue& queue, Shader& shader, const glm::mat4& transform, unsigned int vao);
+	unsigned int DrawIndirectSkinned(Shader& shader, const glm::mat4& transform, unsigned int vao);
+	unsigned int boneCount() const;
+	// animation data, clipSet() is what characters in an AnimationStage
+	// play; it is empty for models that can't be skinned. clips() are the
+	// clips as imported and need keepRawAnimation
+	const std::vector<SkeletonNode>& skeleton() const;
+	const std::vector<Bone>& skinBones() const;
+	const std::vector<AnimationClip>& clips() const;
+	const SoaClipSet& clipSet() const;
+	// all meshes back to back, only kept with cpuSkinning
+	const std::vector<Vertex>& bindPose() const;
+	LoadState state() const;
+	const Bounds& bounds() const;
+	// deletes the async models whose last reference went away on a worker,
+	// context thread only; waitForImports lets running imports finish first,
+	// which is needed once before the context goes away
+	static void deleteRetired(bool waitForImports = false);
 	
 private:
+	friend class ModelHandle;
+	friend class SkinningPass;
+
+	std::string path;
+	std::atomic<LoadState> load_state{ LoadState::Queued };
+	Bounds model_bounds;
+	bool has_bounds = false;
+	// mapped while loading from the bake, geometry is uploaded straight from it
+	ModelCache bake;
+	bool from_cache = false;
 	std::vector<Mesh> meshes;
 	std::string directory;
-	std::vector<Texture> textures_loaded;
-	const aiScene* scene;
+	// by path, the GL textures themselves are owned by the TextureCache
+	std::unordered_map<std::string, Texture> textures_loaded;
+	// path -> TextureCache key of the 2D textures until packTextures
+	std::unordered_map<std::string, uint64_t> texture_keys;
+	// TextureCache keys of the arrays the meshes sample, see packTextures
+	std::vector<uint64_t> texture_array_keys;
+	// GPU memory of the texture arrays this model uploaded, with mips
+	size_t texture_bytes = 0;
+	size_t texture_bytes_uncompressed = 0;
+	std::vector<SkeletonNode> nodes;
+	std::vector<Bone> bones;
+	std::vector<AnimationClip> animations;
+	SoaClipSet clip_set;
+	// only with cpuSkinning, all meshes back to back like in the VBO
+	std::vector<Vertex> bind_pose;
+	// by name, only filled while importing from Assimp
+	std::unordered_map<std::string, int> node_index;
+	std::unordered_map<std::string, int> bone_index;
+	// only valid while loading, points into the aiScene or the mapped cache
+	std::vector<EmbeddedTexture> embedded_textures;
+	// decodes running on the shared pool, uploaded by finishTextures
+	struct PendingTexture
+	{
+		std::string path;
+		std::future<DecodedTexture> decoded;
+	};
+	std::vector<PendingTexture> pending_textures;
+	ModelOptions options;
+	std::unordered_map<unsigned int, MeshUniforms> uniform_cache;
+
+	// all meshes share one VAO/VBO/EBO, there is a single vertex format
+	GLVertexArray VAO;
+	GLBuffer VBO, EBO;
+	// filled on import with compactVertices, freed after the upload
+	std::vector<CompactVertex> compact_vertices;
+
+	// commands are grouped so meshes sharing an index type and texture set
+	// are contiguous
+	struct IndirectBatch
+	{
+		GLenum indexType;
+		std::vector<Texture> textures;
+		unsigned int first;
+		unsigned int count;
+	};
+	GLBuffer indirectBuffer, materialBuffer, quantizationBuffer;
+	std::vector<IndirectBatch> batches;
+	// per-instance model matrices at attribute locations 5-8
+	GLBuffer instanceBuffer;
+	size_t instanceCapacity = 0;
+
+	const MeshUniforms& uniformsFor(const Shader& shader);
+	void setBones(Shader& shader, const MeshUniforms& uniforms, int palette, unsigned int palettes = 1);
+	void setupBuffers();
+	void createBuffers(size_t vertexCount, size_t indexBytes);
+	void uploadRange(unsigned int buffer, size_t offset, const void* data, size_t size);
+	void setupIndirect();
+	unsigned int drawIndirect(Shader& shader, const glm::mat4& transform, int palette, unsigned int vao);
+	// reads positions and normals from a buffer of SkinnedVertex and the
+	// rest from the model's own buffers
+	GLVertexArray createSkinnedVertexArray(unsigned int skinned) const;
+	void keepBindPose(const Vertex* vertices);
+	void uploadInstances(const std::vector<glm::mat4>& transforms);
+	const aiScene* scene = nullptr;
 	Assimp::Importer importer;
 	std::chrono::steady_clock::time_point start_time;
 	bool textured = false;
 	bool animated = false;
 
-	void loadModel(std::string path);
+	Model(std::string path, const ModelOptions& options, bool deferred);
+	// CPU side of loading, no GL calls so it can run on a worker
+	bool import();
+	// GL side of loading, context thread only
+	void upload();
+	bool importCached(const std::string& cachePath, uint64_t sourceHash);
+	void assignRanges();
+	void growBounds(const Vertex* vertices, size_t count);
+	void quantizeMeshes(const Vertex* vertices);
 	void processNode(aiNode* node);
+	void extractNodes(aiNode* node, int parent);
+	void extractAnimations();
+	void extractBones(aiMesh* mesh, std::vector<Vertex>& vertices);
+	void setupAnimation();
 	Mesh processMesh(aiMesh* mesh);
 	Material loadMaterial(aiMaterial* mat);
 	std::vector<Texture> loadMaterialTextures(aiMaterial* mat, aiTextureType type, std::string typeName);
-};
\ No newline at end of file
+	void loadTextures(std::vector<Texture>& textures);
+	bool texturesDecoded() const;
+	void finishTextures();
+	void packTextures(const std::unordered_map<uint64_t, size_t>& uncompressedBytes);
+};
+
+// Model being loaded in the background. poll() once per frame on the context
+// thread; it uploads once the import and its texture decodes are done.
+class ModelHandle
+{
+public:
+	ModelHandle() = default;
+	explicit ModelHandle(std::shared_ptr<Model> model);
+
+	LoadState state() const;
+	bool ready() const;
+	// returns true once the model is resident
+	bool poll();
+	// empty until the model has been imported
+	const Bounds& bounds() const;
+
+	Model& operator*() const;
+	Model* operator->() const;
+
+private:
+	std::shared_ptr<Model> model;
+};
@@ -0,0 +1,356 @@
+#include "ModelCache.h"
+#include "Hash.h"
+#include <cstring>
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <type_traits>
+
+static const char MODEL_CACHE_MAGIC[4] = { 'O', 'G', 'M', 'C' };
+
+namespace {
+
+struct BlobWriter
+{
+	std::vector<unsigned char> bytes;
+
+	template<typename T>
+	void write(const T& value)
+	{
+		static_assert(std::is_trivially_copyable<T>::value, "only plain data can be written");
+		const unsigned char* p = reinterpret_cast<const unsigned char*>(&value);
+		bytes.insert(bytes.end(), p, p + sizeof(T));
+	}
+
+	void write(const void* data, size_t size)
+	{
+		const unsigned char* p = static_cast<const unsigned char*>(data);
+		bytes.insert(bytes.end(), p, p + size);
+	}
+
+	void writeString(const std::string& s)
+	{
+		write((uint32_t)s.size());
+		write(s.data(), s.size());
+	}
+
+	template<typename T>
+	void writeArray(const std::vector<T>& values)
+	{
+		static_assert(std::is_trivially_copyable<T>::value, "only plain data can be written");
+		write((uint32_t)values.size());
+		write(values.data(), values.size() * sizeof(T));
+	}
+};
+
+// bounds checked reader, ok turns false on the first overrun
+struct BlobReader
+{
+	const unsigned char* p;
+	const unsigned char* end;
+	bool ok = true;
+
+	const unsigned char* take(size_t size)
+	{
+		if (!ok || (size_t)(end - p) < size)
+		{
+			ok = false;
+			return nullptr;
+		}
+		const unsigned char* at = p;
+		p += size;
+		return at;
+	}
+
+	template<typename T>
+	T read()
+	{
+		T value{};
+		if (const unsigned char* at = take(sizeof(T)))
+			std::memcpy(&value, at, sizeof(T));
+		return value;
+	}
+
+	std::string readString()
+	{
+		uint32_t size = read<uint32_t>();
+		const unsigned char* at = take(size);
+		return at ? std::string(reinterpret_cast<const char*>(at), size) : std::string();
+	}
+
+	template<typename T>
+	std::vector<T> readArray()
+	{
+		uint32_t count = read<uint32_t>();
+		std::vector<T> values;
+		if (const unsigned char* at = take((size_t)count * sizeof(T)))
+		{
+			values.resize(count);
+			std::memcpy(values.data(), at, (size_t)count * sizeof(T));
+		}
+		return values;
+	}
+};
+
+size_t alignUp(size_t value, size_t alignment)
+{
+	return (value + alignment - 1) / alignment * alignment;
+}
+
+}
+
+uint64_t hashFile(const std::string& path)
+{
+	std::ifstream file(path, std::ios::binary);
+	std::vector<char> chunk(1 << 20);
+	uint64_t hash = FNV_OFFSET_BASIS;
+	while (file)
+	{
+		file.read(chunk.data(), chunk.size());
+		hash = fnv1a(chunk.data(), (size_t)file.gcount(), hash);
+	}
+	return hash;
+}
+
+bool readModelCache(const std::string& path, uint64_t sourceHash, uint32_t importFlags, ModelCache& cache)
+{
+	MappedFile file(path);
+	if (!file.isOpen() || file.size() < sizeof(ModelCacheHeader))
+		return false;
+
+	ModelCacheHeader header;
+	std::memcpy(&header, file.data(), sizeof(header));
+	if (std::memcmp(header.magic, MODEL_CACHE_MAGIC, sizeof(header.magic)) != 0
+		|| header.version != MODEL_CACHE_VERSION
+		|| header.sourceHash != sourceHash
+		|| header.importFlags != importFlags
+		|| header.vertexStride != sizeof(Vertex))
+		return false;
+
+	// written as subtractions so huge values can't wrap around
+	if (header.vertexOffset > file.size() || header.vertexCount > (file.size() - header.vertexOffset) / sizeof(Vertex)
+		|| header.indexOffset > file.size() || header.indexBytes > file.size() - header.indexOffset
+		|| header.metaOffset > file.size() || header.metaSize > file.size() - header.metaOffset)
+	{
+		std::cout << "Model cache \"" << path << "\" is truncated." << std::endl;
+		return false;
+	}
+
+	BlobReader reader{ file.data() + header.metaOffset, file.data() + header.metaOffset + header.metaSize };
+
+	uint32_t meshCount = reader.read<uint32_t>();
+	uint64_t lastBaseVertex = 0;
+	for (uint32_t i = 0; i < meshCount && reader.ok; i++)
+	{
+		CachedMesh mesh;
+		mesh.baseVertex = reader.read<uint32_t>();
+		mesh.indexOffset = (size_t)reader.read<uint64_t>();
+		mesh.indexType = reader.read<uint32_t>();
+		mesh.indexCount = reader.read<uint32_t>();
+
+		// the ranges are drawn and read straight from the mapping
+		uint64_t indexSize = mesh.indexType == GL_UNSIGNED_INT ? 4 : mesh.indexType == GL_UNSIGNED_SHORT ? 2 : 0;
+		if (indexSize == 0
+			|| mesh.indexOffset % indexSize != 0
+			|| mesh.indexOffset > header.indexBytes
+			|| mesh.indexCount > (header.indexBytes - mesh.indexOffset) / indexSize
+			|| mesh.baseVertex < lastBaseVertex
+			|| mesh.baseVertex > header.vertexCount)
+			reader.ok = false;
+		lastBaseVertex = mesh.baseVertex;
+
+		mesh.material = reader.read<Material>();
+		uint32_t textureCount = reader.read<uint32_t>();
+		for (uint32_t t = 0; t < textureCount && reader.ok; t++)
+		{
+			Texture texture;
+			texture.id = 0;
+			texture.type = reader.readString();
+			texture.path = reader.readString();
+			mesh.textures.push_back(texture);
+		}
+		cache.meshes.push_back(std::move(mesh));
+	}
+
+	uint32_t embeddedCount = reader.read<uint32_t>();
+	for (uint32_t i = 0; i < embeddedCount && reader.ok; i++)
+	{
+		uint64_t size = reader.read<uint64_t>();
+		const unsigned char* data = reader.take((size_t)size);
+		cache.embedded.push_back({ data, (size_t)size });
+	}
+
+	uint32_t nodeCount = reader.read<uint32_t>();
+	for (uint32_t i = 0; i < nodeCount && reader.ok; i++)
+	{
+		SkeletonNode node;
+		node.name = reader.readString();
+		node.parent = reader.read<int32_t>();
+		node.transform = reader.read<glm::mat4>();
+		cache.nodes.push_back(std::move(node));
+	}
+
+	cache.bones = reader.readArray<Bone>();
+	for (auto& bone : cache.bones)
+		if (bone.node < 0 || bone.node >= (int)cache.nodes.size())
+			reader.ok = false;
+
+	uint32_t clipCount = reader.read<uint32_t>();
+	for (uint32_t i = 0; i < clipCount && reader.ok; i++)
+	{
+		AnimationClip clip;
+		clip.name = reader.readString();
+		clip.duration = reader.read<float>();
+		clip.ticksPerSecond = reader.read<float>();
+		uint32_t channelCount = reader.read<uint32_t>();
+		for (uint32_t c = 0; c < channelCount && reader.ok; c++)
+		{
+			NodeAnimation channel;
+			channel.node = reader.read<int32_t>();
+			if (channel.node < 0 || channel.node >= (int)cache.nodes.size())
+				reader.ok = false;
+			channel.positions = reader.readArray<VectorKey>();
+			channel.rotations = reader.readArray<QuatKey>();
+			channel.scales = reader.readArray<VectorKey>();
+			clip.channels.push_back(std::move(channel));
+		}
+		cache.animations.push_back(std::move(clip));
+	}
+
+	// skinned vertices index the bone palette with every id
+	const Vertex* vertices = reinterpret_cast<const Vertex*>(file.data() + header.vertexOffset);
+	for (uint64_t v = 0; v < header.vertexCount && reader.ok; v++)
+	{
+		float total = 0.0f;
+		for (int k = 0; k < WEIGHTS_PER_VERTEX; k++)
+			total += vertices[v].Weights[k];
+		if (total > 0.0f)
+			for (int k = 0; k < NUM_BONES_PER_VERTEX; k++)
+				if (vertices[v].BoneIDs[k] < 0 || vertices[v].BoneIDs[k] >= (int)cache.bones.size())
+					reader.ok = false;
+	}
+
+	if (!reader.ok)
+	{
+		std::cout << "Model cache \"" << path << "\" is corrupt." << std::endl;
+		return false;
+	}
+
+	cache.vertices = vertices;
+	cache.vertexCount = (size_t)header.vertexCount;
+	cache.indices = file.data() + header.indexOffset;
+	cache.indexBytes = (size_t)header.indexBytes;
+	cache.file = std::move(file);
+	return true;
+}
+
+bool writeModelCache(const std::string& path, uint64_t sourceHash, uint32_t importFlags,
+	const std::vector<Mesh>& meshes, const std::vector<EmbeddedTexture>& embedded,
+	const std::vector<SkeletonNode>& nodes, const std::vector<Bone>& bones, const std::vector<AnimationClip>& animations)
+{
+	BlobWriter meta;
+	meta.write((uint32_t)meshes.size());
+	for (auto& m : meshes)
+	{
+		meta.write((uint32_t)m.baseVertex);
+		meta.write((uint64_t)m.indexOffset);
+		meta.write((uint32_t)m.indexType);
+		meta.write((uint32_t)m.indexCount);
+		meta.write(m.material);
+		meta.write((uint32_t)m.textures.size());
+		for (auto& t : m.textures)
+		{
+			meta.writeString(t.type);
+			meta.writeString(t.path);
+		}
+	}
+
+	meta.write((uint32_t)embedded.size());
+	for (auto& e : embedded)
+	{
+		meta.write((uint64_t)e.size);
+		meta.write(e.data, e.size);
+	}
+
+	meta.write((uint32_t)nodes.size());
+	for (auto& n : nodes)
+	{
+		meta.writeString(n.name);
+		meta.write((int32_t)n.parent);
+		meta.write(n.transform);
+	}
+
+	meta.writeArray(bones);
+
+	meta.write((uint32_t)animations.size());
+	for (auto& clip : animations)
+	{
+		meta.writeString(clip.name);
+		meta.write(clip.duration);
+		meta.write(clip.ticksPerSecond);
+		meta.write((uint32_t)clip.channels.size());
+		for (auto& channel : clip.channels)
+		{
+			meta.write((int32_t)channel.node);
+			meta.writeArray(channel.positions);
+			meta.writeArray(channel.rotations);
+			meta.writeArray(channel.scales);
+		}
+	}
+
+	size_t vertexCount = 0, indexBytes = 0;
+	for (auto& m : meshes)
+	{
+		vertexCount += m.vertices.size();
+		indexBytes += m.indexCount * m.indexSize();
+	}
+
+	ModelCacheHeader header = {};
+	std::memcpy(header.magic, MODEL_CACHE_MAGIC, sizeof(header.magic));
+	header.version = MODEL_CACHE_VERSION;
+	header.sourceHash = sourceHash;
+	header.importFlags = importFlags;
+	header.vertexStride = sizeof(Vertex);
+	header.vertexCount = vertexCount;
+	header.indexBytes = indexBytes;
+	header.vertexOffset = alignUp(sizeof(ModelCacheHeader), 16);
+	header.indexOffset = header.vertexOffset + vertexCount * sizeof(Vertex);
+	header.metaOffset = alignUp((size_t)(header.indexOffset + indexBytes), 16);
+	header.metaSize = meta.bytes.size();
+
+	// loads may have the old bake mapped
+	std::string temporary = temporaryPath(path);
+	std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+	if (!file)
+	{
+		std::cout << "Cannot write model cache \"" << path << "\"." << std::endl;
+		return false;
+	}
+
+	auto pad = [&](uint64_t offset) {
+		static const char zeros[16] = {};
+		file.write(zeros, (std::streamsize)(offset - (uint64_t)file.tellp()));
+	};
+
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	pad(header.vertexOffset);
+	for (auto& m : meshes)
+		file.write(reinterpret_cast<const char*>(m.vertices.data()), m.vertices.size() * sizeof(Vertex));
+	// index ranges aren't in mesh order
+	std::vector<const Mesh*> byOffset;
+	for (auto& m : meshes)
+		byOffset.push_back(&m);
+	std::sort(byOffset.begin(), byOffset.end(), [](const Mesh* a, const Mesh* b) { return a->indexOffset < b->indexOffset; });
+	for (const Mesh* m : byOffset)
+		file.write(reinterpret_cast<const char*>(m->indexData()), m->indexCount * m->indexSize());
+	pad(header.metaOffset);
+	file.write(reinterpret_cast<const char*>(meta.bytes.data()), meta.bytes.size());
+	file.close();
+
+	if (!replaceFile(temporary, path, (bool)file))
+	{
+		std::cout << "Cannot write model cache \"" << path << "\"." << std::endl;
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "Mesh.h"
+#include "Animation.h"
+#include "MappedFile.h"
+
+// Baked model format, written next to the source file after the first
+// Assimp import and memory mapped on later loads:
+//
+//   ModelCacheHeader
+//   vertex blob  (vertexCount * sizeof(Vertex), 16 byte aligned)
+//   index blob   (indexBytes, 32-bit mesh ranges first, then 16-bit ones)
+//   metadata     (meshes, embedded texture files, nodes, bones, animation clips)
+//
+// The cache is only used when the source hash, import flags, version and
+// vertex layout all match.
+constexpr uint32_t MODEL_CACHE_VERSION = 4;
+
+struct ModelCacheHeader
+{
+	char magic[4];
+	uint32_t version;
+	uint64_t sourceHash;
+	uint32_t importFlags;
+	uint32_t vertexStride;
+	uint64_t vertexCount;
+	uint64_t indexBytes;
+	uint64_t vertexOffset;
+	uint64_t indexOffset;
+	uint64_t metaOffset;
+	uint64_t metaSize;
+};
+
+// compressed image file embedded in the model (png, jpg, ...), size is 0
+// for raw texel data which isn't supported
+struct EmbeddedTexture
+{
+	const unsigned char* data;
+	size_t size;
+};
+
+struct CachedMesh
+{
+	unsigned int baseVertex;
+	size_t indexOffset;
+	unsigned int indexType;
+	unsigned int indexCount;
+	Material material;
+	std::vector<Texture> textures;
+};
+
+// vertices, indices and embedded textures point into the mapped file and
+// stay valid as long as the ModelCache is alive
+struct ModelCache
+{
+	MappedFile file;
+	const Vertex* vertices = nullptr;
+	size_t vertexCount = 0;
+	const unsigned char* indices = nullptr;
+	size_t indexBytes = 0;
+	std::vector<CachedMesh> meshes;
+	std::vector<EmbeddedTexture> embedded;
+	std::vector<SkeletonNode> nodes;
+	std::vector<Bone> bones;
+	std::vector<AnimationClip> animations;
+};
+
+uint64_t hashFile(const std::string& path);
+
+bool readModelCache(const std::string& path, uint64_t sourceHash, uint32_t importFlags, ModelCache& cache);
+
+// meshes must still hold their CPU geometry
+bool writeModelCache(const std::string& path, uint64_t sourceHash, uint32_t importFlags,
+	const std::vector<Mesh>& meshes, const std::vector<EmbeddedTexture>& embedded,
+	const std::vector<SkeletonNode>& nodes, const std::vector<Bone>& bones, const std::vector<AnimationClip>& animations);
@@ -0,0 +1,211 @@
+#include "RenderQueue.h"
+#include <algorithm>
+#include <cstring>
+#include <tuple>
+
+void StateCache::useProgram(unsigned int id)
+{
+	if (changed(program != id))
+	{
+		program = id;
+		glUseProgram(id);
+	}
+}
+
+void StateCache::bindTexture(unsigned int unit, unsigned int texture)
+{
+	if (unit >= MAX_TEXTURE_UNITS || !changed(textures[unit] != texture))
+		return;
+	if (activeUnit != unit)
+	{
+		activeUnit = unit;
+		glActiveTexture(GL_TEXTURE0 + unit);
+	}
+	textures[unit] = texture;
+	glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+}
+
+void StateCache::bindVertexArray(unsigned int id)
+{
+	if (changed(vao != id))
+	{
+		vao = id;
+		glBindVertexArray(id);
+	}
+}
+
+void StateCache::setInt(int location, int value)
+{
+	float data = (float)value;
+	if (uniformChanged(location, &data, 1))
+		glUniform1i(location, value);
+}
+
+void StateCache::setFloat(int location, float value)
+{
+	if (uniformChanged(location, &value, 1))
+		glUniform1f(location, value);
+}
+
+void StateCache::setVec3(int location, const glm::vec3& value)
+{
+	if (uniformChanged(location, &value.x, 3))
+		glUniform3f(location, value.x, value.y, value.z);
+}
+
+void StateCache::setMat4(int location, const glm::mat4& value)
+{
+	if (uniformChanged(location, &value[0][0], 16))
+		glUniformMatrix4fv(location, 1, GL_FALSE, &value[0][0]);
+}
+
+void StateCache::invalidateBindings()
+{
+	// 0 is a valid binding, use values nothing will ever match
+	program = ~0u;
+	vao = ~0u;
+	activeUnit = ~0u;
+	textures.fill(~0u);
+}
+
+void StateCache::invalidate()
+{
+	invalidateBindings();
+	uniforms.clear();
+}
+
+unsigned int StateCache::issuedCount() const
+{
+	return issued;
+}
+
+unsigned int StateCache::skippedCount() const
+{
+	return skipped;
+}
+
+void StateCache::resetCounters()
+{
+	issued = 0;
+	skipped = 0;
+}
+
+bool StateCache::changed(bool different)
+{
+	if (different)
+		issued++;
+	else
+		skipped++;
+	return different;
+}
+
+bool StateCache::uniformChanged(int location, const float* data, size_t count)
+{
+	if (location < 0)
+		return false;
+
+	uint64_t key = (uint64_t)program << 32 | (uint32_t)location;
+	auto [it, inserted] = uniforms.try_emplace(key);
+	if (!changed(inserted || std::memcmp(it->second.data(), data, count * sizeof(float)) != 0))
+		return false;
+	std::memcpy(it->second.data(), data, count * sizeof(float));
+	return true;
+}
+
+void RenderQueue::submit(const DrawItem& item)
+{
+	items.push_back(item);
+}
+
+static bool textureSetLess(const std::vector<Texture>& a, const std::vector<Texture>& b)
+{
+	return std::lexicographical_compare(a.begin(), a.end(), b.begin(), b.end(),
+		[](const Texture& x, const Texture& y) { return x.id < y.id; });
+}
+
+static auto materialKey(const Material& m)
+{
+	return std::make_tuple(m.ambient.x, m.ambient.y, m.ambient.z,
+		m.diffuse.x, m.diffuse.y, m.diffuse.z,
+		m.specular.x, m.specular.y, m.specular.z, m.shininess);
+}
+
+void RenderQueue::flush()
+{
+	static const std::vector<Texture> untextured;
+
+	std::stable_sort(items.begin(), items.end(), [](const DrawItem& a, const DrawItem& b) {
+		if (a.shader->ID != b.shader->ID)
+			return a.shader->ID < b.shader->ID;
+		const std::vector<Texture>& ta = a.textured ? a.mesh->textures : untextured;
+		const std::vector<Texture>& tb = b.textured ? b.mesh->textures : untextured;
+		if (textureSetLess(ta, tb))
+			return true;
+		if (textureSetLess(tb, ta))
+			return false;
+		auto ma = materialKey(a.mesh->material), mb = materialKey(b.mesh->material);
+		if (ma != mb)
+			return ma < mb;
+		if (a.vao != b.vao)
+			return a.vao < b.vao;
+		return a.mesh->indexOffset < b.mesh->indexOffset;
+	});
+
+	// other code binds programs, textures and VAOs directly between flushes
+	cache.invalidateBindings();
+	draws = 0;
+
+	for (const DrawItem& item : items)
+	{
+		const MeshUniforms& u = *item.uniforms;
+		const Mesh& mesh = *item.mesh;
+
+		cache.useProgram(item.shader->ID);
+		cache.setMat4(u.model, item.transform);
+		cache.setInt(u.animated, item.animated);
+		if (item.animated)
+			cache.setInt(u.boneOffset, item.palette);
+		cache.setVec3(u.ambient, mesh.material.ambient);
+		cache.setVec3(u.diffuse, mesh.material.diffuse);
+		cache.setVec3(u.specular, mesh.material.specular);
+		cache.setFloat(u.shininess, mesh.material.shininess);
+		cache.setInt(u.textured, item.textured);
+		cache.setVec3(u.positionOffset, mesh.positionOffset);
+		cache.setVec3(u.positionScale, mesh.positionScale);
+
+		if (item.textured)
+		{
+			unsigned int diffuseNr = 0;
+			unsigned int specularNr = 0;
+			for (unsigned int i = 0; i < mesh.textures.size(); i++)
+			{
+				const std::string& name = mesh.textures[i].type;
+				if (name == "texture_diffuse" && diffuseNr < MAX_SAMPLERS_PER_TYPE)
+				{
+					if (diffuseNr == 0)
+						cache.setInt(u.diffuseLayer, mesh.textures[i].layer);
+					cache.setInt(u.texture_diffuse[diffuseNr++], i);
+				}
+				else if (name == "texture_specular" && specularNr < MAX_SAMPLERS_PER_TYPE)
+					cache.setInt(u.texture_specular[specularNr++], i);
+				cache.bindTexture(i, mesh.textures[i].id);
+			}
+		}
+
+		cache.bindVertexArray(item.vao);
+		glDrawElementsBaseVertex(GL_TRIANGLES, mesh.indexCount, mesh.indexType, (void*)mesh.indexOffset, mesh.baseVertex);
+		draws++;
+	}
+
+	items.clear();
+}
+
+StateCache& RenderQueue::state()
+{
+	return cache;
+}
+
+unsigned int RenderQueue::drawCount() const
+{
+	return draws;
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <array>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include "Shader.h"
+#include "Mesh.h"
+
+constexpr auto MAX_TEXTURE_UNITS = 16;
+
+// Shadows the GL binding state and the uniform values written through it so
+// redundant calls can be dropped. Uniform values are kept per program across
+// frames, so uniforms of a program should only be written through the cache;
+// call invalidate() after touching them directly.
+class StateCache
+{
+public:
+	void useProgram(unsigned int program);
+	// model textures are all GL_TEXTURE_2D_ARRAY
+	void bindTexture(unsigned int unit, unsigned int texture);
+	void bindVertexArray(unsigned int vao);
+	void setInt(int location, int value);
+	void setFloat(int location, float value);
+	void setVec3(int location, const glm::vec3& value);
+	void setMat4(int location, const glm::mat4& value);
+
+	// forget bindings made outside of the cache, uniform values are kept
+	void invalidateBindings();
+	void invalidate();
+
+	unsigned int issuedCount() const;
+	unsigned int skippedCount() const;
+	void resetCounters();
+
+private:
+	unsigned int program = 0;
+	unsigned int vao = 0;
+	unsigned int activeUnit = 0;
+	std::array<unsigned int, MAX_TEXTURE_UNITS> textures{};
+	std::unordered_map<uint64_t, std::array<float, 16>> uniforms;
+	unsigned int issued = 0;
+	unsigned int skipped = 0;
+
+	bool changed(bool different);
+	bool uniformChanged(int location, const float* data, size_t count);
+};
+
+struct DrawItem
+{
+	Shader* shader;
+	const MeshUniforms* uniforms;
+	const Mesh* mesh;
+	unsigned int vao;
+	bool textured;
+	bool animated;
+	glm::mat4 transform;
+	// first matrix of the skinning palette in the AnimationStage buffer
+	int palette;
+};
+
+// Collects draws for a frame, sorts them by program -> texture set ->
+// material -> VAO and submits them through a StateCache.
+class RenderQueue
+{
+public:
+	void submit(const DrawItem& item);
+	void flush();
+
+	StateCache& state();
+	unsigned int drawCount() const;
+
+private:
+	std::vector<DrawItem> items;
+	StateCache cache;
+	unsigned int draws = 0;
+};
@@ -1,6 +1,6 @@
 #include "Shader.h"
 
-Shader::Shader(const char* vertexPath, const char* fragmentPath)
+Shader::Shader(const char* vertexPath, const char* fragmentPath, const std::vector<std::string>& defines)
 {
 	std::string vertexCode, fragmentCode;
 	std::ifstream vShaderFile, fShaderFile;
@@ -22,6 +22,9 @@ Shader::Shader(const char* vertexPath, const char* fragmentPath)
 		std::cout << "Shader files reading is unsuccessful" << std::endl;
 	}
 
+	injectDefines(vertexCode, defines);
+	injectDefines(fragmentCode, defines);
+
 	const char* vShaderCode = vertexCode.c_str();
 	const char* fShaderCode = fragmentCode.c_str();
 
@@ -63,9 +66,135 @@ Shader::Shader(const char* vertexPath, const char* fragmentPath)
 	glDeleteShader(vertex);
 	glDeleteShader(fragment);
 
+	reflectUniforms();
+}
+
+std::unique_ptr<Shader> Shader::compute(const char* computePath, const std::vector<std::string>& defines)
+{
+	std::string computeCode;
+	std::ifstream cShaderFile(computePath);
+	if (!cShaderFile)
+		std::cout << "Shader files reading is unsuccessful" << std::endl;
+	std::stringstream cShaderStream;
+	cShaderStream << cShaderFile.rdbuf();
+	computeCode = cShaderStream.str();
+
+	injectDefines(computeCode, defines);
+	const char* cShaderCode = computeCode.c_str();
+
+	int success;
+	char infoLog[512];
+
+	unsigned int compute = glCreateShader(GL_COMPUTE_SHADER);
+	glShaderSource(compute, 1, &cShaderCode, nullptr);
+	glCompileShader(compute);
+	glGetShaderiv(compute, GL_COMPILE_STATUS, &success);
+	if (!success)
+	{
+		glGetShaderInfoLog(compute, 512, nullptr, infoLog);
+		std::cout << "Compute shader compilation failed\n" << infoLog << std::endl;
+	}
+
+	std::unique_ptr<Shader> shader(new Shader());
+	shader->ID = glCreateProgram();
+	glAttachShader(shader->ID, compute);
+	glLinkProgram(shader->ID);
+	glGetProgramiv(shader->ID, GL_LINK_STATUS, &success);
+	if (!success)
+	{
+		glGetProgramInfoLog(shader->ID, 512, nullptr, infoLog);
+		std::cout << "Shader program linking failed\n" << infoLog << std::endl;
+	}
+
+	glDeleteShader(compute);
+
+	shader->reflectUniforms();
+	return shader;
+}
+
+Shader::~Shader()
+{
+	glDeleteProgram(ID);
+}
+
+unsigned int Shader::lookups = 0;
+
+void Shader::injectDefines(std::string& code, const std::vector<std::string>& defines)
+{
+	if (defines.empty())
+		return;
+
+	std::string block;
+	for (auto& define : defines)
+		block += "#define " + define + "\n";
+
+	size_t version = code.find("#version");
+	size_t lineEnd = version == std::string::npos ? std::string::npos : code.find('\n', version);
+	if (lineEnd == std::string::npos)
+		code.insert(0, block);
+	else
+		code.insert(lineEnd + 1, block);
+}
+
+void Shader::bindUniformBlock(const std::string& name, unsigned int binding) const
+{
+	unsigned int index = glGetUniformBlockIndex(ID, name.c_str());
+	if (index != GL_INVALID_INDEX)
+		glUniformBlockBinding(ID, index, binding);
+}
+
+void Shader::reflectUniforms()
+{
+	int count = 0, maxLength = 0;
+	glGetProgramiv(ID, GL_ACTIVE_UNIFORMS, &count);
+	glGetProgramiv(ID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+
+	std::vector<char> buffer(maxLength + 1);
+	for (int i = 0; i < count; i++)
+	{
+		int length = 0, size = 0;
+		GLenum type;
+		glGetActiveUniform(ID, i, maxLength, &length, &size, &type, buffer.data());
+		std::string name(buffer.data(), length);
+
+		int location = glGetUniformLocation(ID, name.c_str());
+		if (location < 0) // uniform block members have no location
+			continue;
+		uniforms[name] = location;
+
+		// arrays are reported once as "name[0]", register every element
+		// and the bare name so both spellings resolve
+		if (name.size() > 3 && name.compare(name.size() - 3, 3, "[0]") == 0)
+		{
+			std::string base = name.substr(0, name.size() - 3);
+			uniforms[base] = location;
+			for (int e = 1; e < size; e++)
+			{
+				std::string element = base + "[" + std::to_string(e) + "]";
+				uniforms[element] = glGetUniformLocation(ID, element.c_str());
+			}
+		}
+	}
 }
 
-Shader::~Shader() {}
+int Shader::getUniformLocation(const std::string& name) const
+{
+	lookups++;
+	auto it = uniforms.find(name);
+	return it != uniforms.end() ? it->second : -1;
+}
+
+unsigned int Shader::lookupCount()
+{
+	return lookups;
+}
+
+unsigned int Shader::resetLookupCount()
+{
+	unsigned int count = lookups;
+	lookups = 0;
+	return count;
+}
 
 void Shader::use()
 {
@@ -74,59 +203,55 @@ void Shader::use()
 
 void Shader::setBool(const std::string& name, bool value) const
 {
-	glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value);
+	setBool(getUniformLocation(name), value);
 }
 
 void Shader::setInt(const std::string& name, int value) const
 {
-	glUniform1i(glGetUniformLocation(ID, name.c_str()), value);
+	setInt(getUniformLocation(name), value);
 }
 
 void Shader::setFloat(const std::string& name, float value) const
 {
-	glUniform1f(glGetUniformLocation(ID, name.c_str()), value);
+	setFloat(getUniformLocation(name), value);
 }
 
 void Shader::setMat4(const std::string& name, const glm::mat4 &mat) const
 {
-	glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+	setMat4(getUniformLocation(name), mat);
 }
 
 void Shader::setVec3(const std::string& name, const glm::vec3& vec) const
 {
-	glUniform3f(glGetUniformLocation(ID, name.c_str()), vec.x, vec.y, vec.z);
-}
-
-void Shader::setDirectionalLight(const std::string& name, const Dirlight& light) const
-{
-	setVec3(name + ".direction", light.direction);
-	setVec3(name + ".ambient", light.ambient);
-	setVec3(name + ".diffuse", light.diffuse);
-	setVec3(name + ".specular", light.specular);
-	setVec3(name + ".color", light.color);
-}
-void Shader::setPointLight(const std::string& name, const Pointlight& light) const
-{
-	setVec3(name + ".position", light.position);
-	setVec3(name + ".ambient", light.ambient);
-	setVec3(name + ".diffuse", light.diffuse);
-	setVec3(name + ".specular", light.specular);
-	setVec3(name + ".color", light.color);
-	setFloat(name + ".constant", light.constant);
-	setFloat(name + ".linear", light.linear);
-	setFloat(name + ".quadratic", light.quadratic);
-}
-void Shader::setSpotLight(const std::string& name, const Spotlight& light) const
-{
-	setVec3(name + ".position", light.position);
-	setVec3(name + ".direction", light.direction);
-	setVec3(name + ".ambient", light.ambient);
-	setVec3(name + ".diffuse", light.diffuse);
-	setVec3(name + ".specular", light.specular);
-	setVec3(name + ".color", light.color);
-	setFloat(name + ".innerCutoff", light.innerCutoff);
-	setFloat(name + ".outerCutoff", light.outerCutoff);
-	setFloat(name + ".constant", light.constant);
-	setFloat(name + ".linear", light.linear);
-	setFloat(name + ".quadratic", light.quadratic);
+	setVec3(getUniformLocation(name), vec);
+}
+
+void Shader::setBool(int location, bool value) const
+{
+	glUniform1i(location, (int)value);
+}
+
+void Shader::setInt(int location, int value) const
+{
+	glUniform1i(location, value);
+}
+
+void Shader::setFloat(int location, float value) const
+{
+	glUniform1f(location, value);
+}
+
+void Shader::setMat4(int location, const glm::mat4& mat) const
+{
+	glUniformMatrix4fv(location, 1, GL_FALSE, &mat[0][0]);
+}
+
+void Shader::setMat4Array(int location, const glm::mat4* mats, size_t count) const
+{
+	glUniformMatrix4fv(location, (GLsizei)count, GL_FALSE, &mats[0][0][0]);
+}
+
+void Shader::setVec3(int location, const glm::vec3& vec) const
+{
+	glUniform3f(location, vec.x, vec.y, vec.z);
 }
\ No newline at end of file
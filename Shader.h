@@ -8,24 +8,53 @@
 #include <fstream>
 #include <sstream>
 #include <iostream>
-
-#include "Light.h"
+#include <unordered_map>
+#include <vector>
+#include <memory>
 
 class Shader
 {
 public:
 	unsigned int ID;
-	Shader(const char* vertexPath, const char* fragmentPath);
+	// defines are inserted right after the #version line of both stages
+	Shader(const char* vertexPath, const char* fragmentPath, const std::vector<std::string>& defines = {});
+	// compute program, defines go after the #version line as above
+	static std::unique_ptr<Shader> compute(const char* computePath, const std::vector<std::string>& defines = {});
+	Shader(const Shader&) = delete;
+	Shader& operator=(const Shader&) = delete;
 	~Shader();
 	void use();
+	void bindUniformBlock(const std::string& name, unsigned int binding) const;
+
+	// name based lookups go through the reflected table and are counted,
+	// resolve locations once and use the handle setters in per-frame code.
+	int getUniformLocation(const std::string& name) const;
+
 	void setBool(const std::string& name, bool value) const;
 	void setInt(const std::string& name, int value) const;
 	void setFloat(const std::string& name, float value) const;
 	void setMat4(const std::string& name, const glm::mat4& mat) const;
 	void setVec3(const std::string& name, const glm::vec3& vec) const;
-	void setDirectionalLight(const std::string& name, const Dirlight& light) const;
-	void setPointLight(const std::string& name, const Pointlight& light) const;
-	void setSpotLight(const std::string& name, const Spotlight& light) const;
+
+	void setBool(int location, bool value) const;
+	void setInt(int location, int value) const;
+	void setFloat(int location, float value) const;
+	void setMat4(int location, const glm::mat4& mat) const;
+	void setMat4Array(int location, const glm::mat4* mats, size_t count) const;
+	void setVec3(int location, const glm::vec3& vec) const;
+
+	// number of name lookups since the last reset, reset once per frame
+	static unsigned int lookupCount();
+	static unsigned int resetLookupCount();
+
+private:
+	std::unordered_map<std::string, int> uniforms;
+	static unsigned int lookups;
+
+	Shader() = default;
+
+	void reflectUniforms();
+	static void injectDefines(std::string& code, const std::vector<std::string>& defines);
 };
 
 #endif
\ No newline at end of file
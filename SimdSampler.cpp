@@ -0,0 +1,384 @@
+#include "SimdSampler.h"
+#include "AnimationCompression.h"
+#include <algorithm>
+#include <cmath>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#define SAMPLER_AVX
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_IX86)
+#include <emmintrin.h>
+#define SAMPLER_SSE
+#endif
+
+namespace {
+
+// SAMPLER_LANES floats with the handful of operations the sampler needs
+#if defined(SAMPLER_AVX)
+struct Lane { __m256 v; };
+inline Lane load(const float* p) { return { _mm256_loadu_ps(p) }; }
+inline void store(float* p, Lane a) { _mm256_storeu_ps(p, a.v); }
+inline Lane splat(float s) { return { _mm256_set1_ps(s) }; }
+inline Lane operator+(Lane a, Lane b) { return { _mm256_add_ps(a.v, b.v) }; }
+inline Lane operator-(Lane a, Lane b) { return { _mm256_sub_ps(a.v, b.v) }; }
+inline Lane operator*(Lane a, Lane b) { return { _mm256_mul_ps(a.v, b.v) }; }
+inline Lane operator/(Lane a, Lane b) { return { _mm256_div_ps(a.v, b.v) }; }
+inline Lane squareRoot(Lane a) { return { _mm256_sqrt_ps(a.v) }; }
+// b with its sign flipped where s is negative
+inline Lane flipSign(Lane b, Lane s) { return { _mm256_xor_ps(b.v, _mm256_and_ps(s.v, _mm256_set1_ps(-0.0f))) }; }
+#elif defined(SAMPLER_SSE)
+struct Lane { __m128 v; };
+inline Lane load(const float* p) { return { _mm_loadu_ps(p) }; }
+inline void store(float* p, Lane a) { _mm_storeu_ps(p, a.v); }
+inline Lane splat(float s) { return { _mm_set1_ps(s) }; }
+inline Lane operator+(Lane a, Lane b) { return { _mm_add_ps(a.v, b.v) }; }
+inline Lane operator-(Lane a, Lane b) { return { _mm_sub_ps(a.v, b.v) }; }
+inline Lane operator*(Lane a, Lane b) { return { _mm_mul_ps(a.v, b.v) }; }
+inline Lane operator/(Lane a, Lane b) { return { _mm_div_ps(a.v, b.v) }; }
+inline Lane squareRoot(Lane a) { return { _mm_sqrt_ps(a.v) }; }
+// b with its sign flipped where s is negative
+inline Lane flipSign(Lane b, Lane s) { return { _mm_xor_ps(b.v, _mm_and_ps(s.v, _mm_set1_ps(-0.0f))) }; }
+#else
+struct Lane { float v[SAMPLER_LANES]; };
+inline Lane load(const float* p) { Lane r; std::copy(p, p + SAMPLER_LANES, r.v); return r; }
+inline void store(float* p, Lane a) { std::copy(a.v, a.v + SAMPLER_LANES, p); }
+inline Lane splat(float s) { Lane r; std::fill(r.v, r.v + SAMPLER_LANES, s); return r; }
+#define LANE_OP(op) \
+	inline Lane operator op(Lane a, Lane b) { for (unsigned int i = 0; i < SAMPLER_LANES; i++) a.v[i] = a.v[i] op b.v[i]; return a; }
+LANE_OP(+) LANE_OP(-) LANE_OP(*) LANE_OP(/)
+#undef LANE_OP
+inline Lane squareRoot(Lane a) { for (unsigned int i = 0; i < SAMPLER_LANES; i++) a.v[i] = std::sqrt(a.v[i]); return a; }
+// b with its sign flipped where s is negative
+inline Lane flipSign(Lane b, Lane s) { for (unsigned int i = 0; i < SAMPLER_LANES; i++) if (std::signbit(s.v[i])) b.v[i] = -b.v[i]; return b; }
+#endif
+
+// out = a * b, column major like glm
+inline void multiply(const glm::mat4& a, const glm::mat4& b, glm::mat4& out)
+{
+#if defined(SAMPLER_SSE)
+	const float* pa = &a[0][0];
+	const float* pb = &b[0][0];
+	float* po = &out[0][0];
+	__m128 a0 = _mm_loadu_ps(pa), a1 = _mm_loadu_ps(pa + 4), a2 = _mm_loadu_ps(pa + 8), a3 = _mm_loadu_ps(pa + 12);
+	for (int c = 0; c < 4; c++)
+	{
+		__m128 column = _mm_mul_ps(a0, _mm_set1_ps(pb[c * 4]));
+		column = _mm_add_ps(column, _mm_mul_ps(a1, _mm_set1_ps(pb[c * 4 + 1])));
+		column = _mm_add_ps(column, _mm_mul_ps(a2, _mm_set1_ps(pb[c * 4 + 2])));
+		column = _mm_add_ps(column, _mm_mul_ps(a3, _mm_set1_ps(pb[c * 4 + 3])));
+		_mm_storeu_ps(po + c * 4, column);
+	}
+#else
+	out = a * b;
+#endif
+}
+
+// keys of one component set, gathered per lane before the SIMD math
+struct KeyPair
+{
+	float a[4][SAMPLER_LANES];
+	float b[4][SAMPLER_LANES];
+	float factor[SAMPLER_LANES];
+};
+
+}
+
+SoaClipSet::SoaClipSet(const std::vector<SkeletonNode>& nodes, const std::vector<Bone>& bones,
+	const std::vector<AnimationClip>& clips)
+	:bones(bones)
+{
+	for (auto& node : nodes)
+	{
+		parents.push_back(node.parent);
+		bind.push_back(node.transform);
+	}
+	if (!nodes.empty())
+		global_inverse = glm::inverse(nodes[0].transform);
+
+	for (auto& source : clips)
+	{
+		Clip clip;
+		clip.duration = source.duration;
+		clip.ticksPerSecond = source.ticksPerSecond;
+		clip.animated.assign(nodes.size(), false);
+		for (Track* track : { &clip.positions, &clip.rotations, &clip.scales })
+		{
+			track->start.assign(nodes.size(), 0);
+			track->count.assign(nodes.size(), 0);
+		}
+		for (Track* track : { &clip.positions, &clip.scales })
+		{
+			track->rangeMin.assign(nodes.size(), glm::vec3(0.0f));
+			track->rangeExtent.assign(nodes.size(), glm::vec3(0.0f));
+		}
+
+		float timeScale = clip.duration > 0.0f ? 65535.0f / clip.duration : 0.0f;
+		auto quantizeTime = [timeScale](float time) {
+			return (uint16_t)std::lround(std::clamp(time * timeScale, 0.0f, 65535.0f));
+		};
+
+		for (auto& channel : source.channels)
+		{
+			int n = channel.node;
+			clip.animated[n] = true;
+
+			// an animated node always gets at least one key per track
+			auto addVectors = [&](Track& track, const std::vector<VectorKey>& keys, const glm::vec3& fallback) {
+				track.start[n] = (uint32_t)track.times.size();
+				track.count[n] = keys.empty() ? 1 : (uint32_t)keys.size();
+				glm::vec3 min = keys.empty() ? fallback : keys[0].value, max = min;
+				for (auto& key : keys)
+				{
+					min = glm::min(min, key.value);
+					max = glm::max(max, key.value);
+				}
+				track.rangeMin[n] = min;
+				track.rangeExtent[n] = max - min;
+				if (keys.empty())
+				{
+					track.times.push_back(0);
+					track.values.insert(track.values.end(), { 0, 0, 0 });
+				}
+				for (auto& key : keys)
+				{
+					track.times.push_back(quantizeTime(key.time));
+					for (int c = 0; c < 3; c++)
+						track.values.push_back(packUnorm16(key.value[c], min[c], track.rangeExtent[n][c]));
+				}
+			};
+			addVectors(clip.positions, channel.positions, glm::vec3(0.0f));
+			addVectors(clip.scales, channel.scales, glm::vec3(1.0f));
+
+			Track& rotations = clip.rotations;
+			rotations.start[n] = (uint32_t)rotations.times.size();
+			rotations.count[n] = channel.rotations.empty() ? 1 : (uint32_t)channel.rotations.size();
+			uint16_t packed[3];
+			if (channel.rotations.empty())
+			{
+				packQuat(glm::quat(1.0f, 0.0f, 0.0f, 0.0f), packed);
+				rotations.times.push_back(0);
+				rotations.values.insert(rotations.values.end(), packed, packed + 3);
+			}
+			for (auto& key : channel.rotations)
+			{
+				packQuat(key.value, packed);
+				rotations.times.push_back(quantizeTime(key.time));
+				rotations.values.insert(rotations.values.end(), packed, packed + 3);
+			}
+		}
+		this->clips.push_back(std::move(clip));
+	}
+}
+
+unsigned int SoaClipSet::nodeCount() const
+{
+	return (unsigned int)parents.size();
+}
+
+unsigned int SoaClipSet::boneCount() const
+{
+	return (unsigned int)bones.size();
+}
+
+unsigned int SoaClipSet::clipCount() const
+{
+	return (unsigned int)clips.size();
+}
+
+size_t SoaClipSet::clipBytes(unsigned int clip) const
+{
+	const Clip& c = clips[clip];
+	size_t bytes = c.animated.size() / 8;
+	for (const Track* track : { &c.positions, &c.rotations, &c.scales })
+		bytes += (track->start.size() + track->count.size()) * sizeof(uint32_t)
+			+ (track->times.size() + track->values.size()) * sizeof(uint16_t)
+			+ (track->rangeMin.size() + track->rangeExtent.size()) * sizeof(glm::vec3);
+	return bytes;
+}
+
+SimdSampler::SimdSampler(const SoaClipSet& set)
+	:set(&set)
+{
+	size_t nodes = set.nodeCount();
+	position_cursors.assign(nodes, 0);
+	rotation_cursors.assign(nodes, 0);
+	scale_cursors.assign(nodes, 0);
+	locals.resize(nodes);
+	globals.resize(nodes);
+	bone_palette.assign(set.boneCount(), glm::mat4(1.0f));
+}
+
+void SimdSampler::evaluate(unsigned int clip, float seconds)
+{
+	evaluate(clip, seconds, bone_palette.data());
+}
+
+void SimdSampler::evaluate(unsigned int clip, float seconds, glm::mat4* palette)
+{
+	if (!set || clip >= set->clips.size())
+		return;
+
+	const SoaClipSet::Clip& animation = set->clips[clip];
+	float ticks = seconds * animation.ticksPerSecond;
+	float time = animation.duration > 0.0f ? std::fmod(ticks, animation.duration) : 0.0f;
+	if (clip != current_clip || time < last_time)
+	{
+		std::fill(position_cursors.begin(), position_cursors.end(), 0);
+		std::fill(rotation_cursors.begin(), rotation_cursors.end(), 0);
+		std::fill(scale_cursors.begin(), scale_cursors.end(), 0);
+		current_clip = clip;
+	}
+	last_time = time;
+
+	// moves the lane's cursor up to the last key at or before time and
+	// gathers that key and the next one, decoded
+	float keyTime = animation.duration > 0.0f ? time * (65535.0f / animation.duration) : 0.0f;
+	auto gatherKeys = [keyTime](const SoaClipSet::Track& track, int node, unsigned int lane,
+		uint32_t& cursor, bool rotation, KeyPair& keys) {
+		uint32_t start = track.start[node], count = track.count[node];
+		while (cursor + 1 < count && track.times[start + cursor + 1] <= keyTime)
+			cursor++;
+		uint32_t a = start + cursor;
+		uint32_t b = cursor + 1 < count ? a + 1 : a;
+		float span = (float)track.times[b] - (float)track.times[a];
+		keys.factor[lane] = span > 0.0f ? std::clamp((keyTime - track.times[a]) / span, 0.0f, 1.0f) : 0.0f;
+
+		const uint16_t* first = &track.values[a * 3];
+		const uint16_t* second = &track.values[b * 3];
+		if (rotation)
+		{
+			glm::quat qa = unpackQuat(first), qb = unpackQuat(second);
+			for (int c = 0; c < 4; c++)
+			{
+				keys.a[c][lane] = qa[c];
+				keys.b[c][lane] = qb[c];
+			}
+			return;
+		}
+		const glm::vec3& min = track.rangeMin[node];
+		const glm::vec3& extent = track.rangeExtent[node];
+		for (int c = 0; c < 3; c++)
+		{
+			keys.a[c][lane] = unpackUnorm16(first[c], min[c], extent[c]);
+			keys.b[c][lane] = unpackUnorm16(second[c], min[c], extent[c]);
+		}
+	};
+
+	size_t nodeCount = set->parents.size();
+	KeyPair positions = {}, rotations = {}, scales = {};
+	// unused lanes interpolate identity keys
+	for (unsigned int l = 0; l < SAMPLER_LANES; l++)
+	{
+		rotations.a[3][l] = rotations.b[3][l] = 1.0f;
+		scales.a[0][l] = scales.a[1][l] = scales.a[2][l] = 1.0f;
+		scales.b[0][l] = scales.b[1][l] = scales.b[2][l] = 1.0f;
+	}
+
+	for (size_t first = 0; first < nodeCount; first += SAMPLER_LANES)
+	{
+		unsigned int lanes = (unsigned int)std::min<size_t>(SAMPLER_LANES, nodeCount - first);
+		bool any = false;
+		for (unsigned int l = 0; l < lanes; l++)
+		{
+			int n = (int)(first + l);
+			if (!animation.animated[n])
+				continue;
+			any = true;
+			gatherKeys(animation.positions, n, l, position_cursors[n], false, positions);
+			gatherKeys(animation.rotations, n, l, rotation_cursors[n], true, rotations);
+			gatherKeys(animation.scales, n, l, scale_cursors[n], false, scales);
+		}
+		if (!any)
+		{
+			for (unsigned int l = 0; l < lanes; l++)
+				locals[first + l] = set->bind[first + l];
+			continue;
+		}
+
+		// translation and scale lerp
+		Lane tf = load(positions.factor), sf = load(scales.factor);
+		Lane t[3], s[3];
+		for (int c = 0; c < 3; c++)
+		{
+			Lane ta = load(positions.a[c]), sa = load(scales.a[c]);
+			t[c] = ta + (load(positions.b[c]) - ta) * tf;
+			s[c] = sa + (load(scales.b[c]) - sa) * sf;
+		}
+
+		// nlerp along the shorter arc
+		Lane qa[4], qb[4];
+		for (int c = 0; c < 4; c++)
+		{
+			qa[c] = load(rotations.a[c]);
+			qb[c] = load(rotations.b[c]);
+		}
+		Lane dot = qa[0] * qb[0] + qa[1] * qb[1] + qa[2] * qb[2] + qa[3] * qb[3];
+		Lane rf = load(rotations.factor);
+		Lane q[4];
+		for (int c = 0; c < 4; c++)
+			q[c] = qa[c] + (flipSign(qb[c], dot) - qa[c]) * rf;
+		Lane length = squareRoot(q[0] * q[0] + q[1] * q[1] + q[2] * q[2] + q[3] * q[3]);
+		for (int c = 0; c < 4; c++)
+			q[c] = q[c] / length;
+
+		// translate * mat4_cast(q) * scale, one matrix element per lane register
+		Lane one = splat(1.0f), two = splat(2.0f);
+		Lane xx = q[0] * q[0], yy = q[1] * q[1], zz = q[2] * q[2];
+		Lane xy = q[0] * q[1], xz = q[0] * q[2], yz = q[1] * q[2];
+		Lane wx = q[3] * q[0], wy = q[3] * q[1], wz = q[3] * q[2];
+		Lane m[4][3] = {
+			{ (one - two * (yy + zz)) * s[0], two * (xy + wz) * s[0], two * (xz - wy) * s[0] },
+			{ two * (xy - wz) * s[1], (one - two * (xx + zz)) * s[1], two * (yz + wx) * s[1] },
+			{ two * (xz + wy) * s[2], two * (yz - wx) * s[2], (one - two * (xx + yy)) * s[2] },
+			{ t[0], t[1], t[2] }
+		};
+
+		float element[SAMPLER_LANES];
+		for (int c = 0; c < 4; c++)
+			for (int r = 0; r < 3; r++)
+			{
+				store(element, m[c][r]);
+				for (unsigned int l = 0; l < lanes; l++)
+					locals[first + l][c][r] = element[l];
+			}
+		for (unsigned int l = 0; l < lanes; l++)
+		{
+			size_t n = first + l;
+			if (animation.animated[n])
+			{
+				locals[n][0][3] = locals[n][1][3] = locals[n][2][3] = 0.0f;
+				locals[n][3][3] = 1.0f;
+			}
+			else
+				locals[n] = set->bind[n];
+		}
+	}
+
+	// parents come first, their global transform is already final
+	for (size_t n = 0; n < nodeCount; n++)
+	{
+		int parent = set->parents[n];
+		if (parent >= 0)
+			multiply(globals[parent], locals[n], globals[n]);
+		else
+			globals[n] = locals[n];
+	}
+
+	glm::mat4 model;
+	for (size_t b = 0; b < set->bones.size(); b++)
+	{
+		multiply(set->global_inverse, globals[set->bones[b].node], model);
+		multiply(model, set->bones[b].offset, palette[b]);
+	}
+}
+
+const std::vector<glm::mat4>& SimdSampler::palette() const
+{
+	return bone_palette;
+}
+
+const std::vector<glm::mat4>& SimdSampler::globalTransforms() const
+{
+	return globals;
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <vector>
+#include "Animation.h"
+
+// nodes interpolated per step: AVX lanes when compiled for it, SSE (or the
+// scalar fallback) otherwise
+#if defined(__AVX__)
+constexpr unsigned int SAMPLER_LANES = 8;
+#else
+constexpr unsigned int SAMPLER_LANES = 4;
+#endif
+
+// Structure-of-arrays copy of a model's clips, shared by every character
+// playing them. Each clip stores per node where its translation, rotation
+// and scale keys start; key times and components live in flat arrays,
+// quantized: times to 16 bits of the clip's duration, translations and
+// scales to unorm16 inside the node's range, rotations as smallest three
+// (see AnimationCompression.h). Keys are decoded as they're sampled.
+class SoaClipSet
+{
+public:
+	SoaClipSet() = default;
+	SoaClipSet(const std::vector<SkeletonNode>& nodes, const std::vector<Bone>& bones,
+		const std::vector<AnimationClip>& clips);
+
+	unsigned int nodeCount() const;
+	unsigned int boneCount() const;
+	unsigned int clipCount() const;
+	// memory taken by a clip's keys and tables
+	size_t clipBytes(unsigned int clip) const;
+
+private:
+	friend class SimdSampler;
+
+	struct Track
+	{
+		// per node, count is 0 for nodes the clip doesn't animate
+		std::vector<uint32_t> start;
+		std::vector<uint32_t> count;
+		// in units of the clip's duration / 65535
+		std::vector<uint16_t> times;
+		// three words per key
+		std::vector<uint16_t> values;
+		// per node, translations and scales only
+		std::vector<glm::vec3> rangeMin, rangeExtent;
+	};
+	struct Clip
+	{
+		float duration;
+		float ticksPerSecond;
+		Track positions, rotations, scales;
+		std::vector<bool> animated;
+	};
+
+	std::vector<int> parents;
+	std::vector<glm::mat4> bind;
+	std::vector<Bone> bones;
+	std::vector<Clip> clips;
+	glm::mat4 global_inverse = glm::mat4(1.0f);
+};
+
+// Playback state of one character. Keyframe cursors remember where the
+// previous evaluation was, so as time moves forward the key search is
+// amortized O(1); they reset when the clip changes or time wraps.
+// Translation, rotation (nlerp) and scale of SAMPLER_LANES nodes are
+// interpolated and turned into matrices at once, the hierarchy and
+// palette products are SSE 4x4 multiplies.
+class SimdSampler
+{
+public:
+	SimdSampler() = default;
+	explicit SimdSampler(const SoaClipSet& set);
+
+	// seconds wraps around the clip's duration
+	void evaluate(unsigned int clip, float seconds);
+	// same, writing the boneCount() matrices to palette instead of palette()
+	void evaluate(unsigned int clip, float seconds, glm::mat4* palette);
+	const std::vector<glm::mat4>& palette() const;
+	// per node, model space
+	const std::vector<glm::mat4>& globalTransforms() const;
+
+private:
+	const SoaClipSet* set = nullptr;
+	unsigned int current_clip = ~0u;
+	float last_time = 0.0f;
+	std::vector<uint32_t> position_cursors, rotation_cursors, scale_cursors;
+	std::vector<glm::mat4> locals;
+	std::vector<glm::mat4> globals;
+	std::vector<glm::mat4> bone_palette;
+};
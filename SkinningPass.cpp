@@ -0,0 +1,186 @@
+#include "SkinningPass.h"
+#include "Model.h"
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_IX86)
+#include <emmintrin.h>
+#define SKINNING_SSE
+#endif
+
+// vertices per skin.comp work group and per parallelFor chunk on the CPU
+constexpr unsigned int SKIN_GROUP_SIZE = 64;
+constexpr size_t SKIN_CPU_GRAIN = 1024;
+
+void skinVertices(const Vertex* vertices, size_t count, const glm::mat4* palette, SkinnedVertex* out)
+{
+	for (size_t i = 0; i < count; i++)
+	{
+		const Vertex& v = vertices[i];
+		float total = v.Weights[0] + v.Weights[1] + v.Weights[2] + v.Weights[3];
+		if (total <= 0.0f)
+		{
+			out[i].position = glm::vec4(v.Position, 1.0f);
+			out[i].normal = glm::vec4(v.Normal, 0.0f);
+			continue;
+		}
+
+		float scale = 1.0f / total;
+#if defined(SKINNING_SSE)
+		// columns of the blended matrix
+		__m128 c[4] = { _mm_setzero_ps(), _mm_setzero_ps(), _mm_setzero_ps(), _mm_setzero_ps() };
+		for (int k = 0; k < NUM_BONES_PER_VERTEX; k++)
+		{
+			if (v.Weights[k] == 0.0f)
+				continue;
+			__m128 weight = _mm_set1_ps(v.Weights[k] * scale);
+			const float* bone = &palette[v.BoneIDs[k]][0][0];
+			for (int column = 0; column < 4; column++)
+				c[column] = _mm_add_ps(c[column], _mm_mul_ps(weight, _mm_loadu_ps(bone + column * 4)));
+		}
+		__m128 position = _mm_add_ps(_mm_add_ps(_mm_mul_ps(c[0], _mm_set1_ps(v.Position.x)), _mm_mul_ps(c[1], _mm_set1_ps(v.Position.y))),
+			_mm_add_ps(_mm_mul_ps(c[2], _mm_set1_ps(v.Position.z)), c[3]));
+		__m128 normal = _mm_add_ps(_mm_add_ps(_mm_mul_ps(c[0], _mm_set1_ps(v.Normal.x)), _mm_mul_ps(c[1], _mm_set1_ps(v.Normal.y))),
+			_mm_mul_ps(c[2], _mm_set1_ps(v.Normal.z)));
+		_mm_storeu_ps(&out[i].position[0], position);
+		_mm_storeu_ps(&out[i].normal[0], normal);
+		out[i].position.w = 1.0f;
+		out[i].normal.w = 0.0f;
+#else
+		glm::mat4 skin(0.0f);
+		for (int k = 0; k < NUM_BONES_PER_VERTEX; k++)
+			skin += palette[v.BoneIDs[k]] * (v.Weights[k] * scale);
+		out[i].position = glm::vec4(glm::vec3(skin * glm::vec4(v.Position, 1.0f)), 1.0f);
+		out[i].normal = glm::vec4(glm::mat3(skin) * v.Normal, 0.0f);
+#endif
+		float length = glm::length(glm::vec3(out[i].normal));
+		if (length > 0.0f)
+			out[i].normal /= length;
+	}
+}
+
+SkinningPass::SkinningPass(Mode mode)
+	:skin_mode(mode)
+{
+}
+
+unsigned int SkinningPass::add(const Model& model, int palette)
+{
+	if (palette < 0 || model.meshes.empty())
+		return 0;
+	if (skin_mode == Mode::Cpu && model.bind_pose.empty())
+	{
+		std::cout << model.path << ": no bind pose kept for CPU skinning, import it with cpuSkinning" << std::endl;
+		return 0;
+	}
+
+	Target target;
+	target.model = &model;
+	target.palette = palette;
+	size_t count = model.meshes.back().baseVertex + model.meshes.back().vertexCount;
+	target.buffer = GLBuffer::create();
+	glBindBuffer(GL_ARRAY_BUFFER, target.buffer);
+	target.capacity = count * sizeof(SkinnedVertex);
+	glBufferData(GL_ARRAY_BUFFER, target.capacity, nullptr,
+		skin_mode == Mode::Cpu ? GL_STREAM_DRAW : GL_DYNAMIC_COPY);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	target.vao = model.createSkinnedVertexArray(target.buffer);
+	if (skin_mode == Mode::Cpu)
+		target.skinned.resize(count);
+
+	unsigned int vao = target.vao;
+	targets.push_back(std::move(target));
+	return vao;
+}
+
+void SkinningPass::run(const AnimationStage& stage)
+{
+	vertices = 0;
+	indices = 0;
+	for (auto& target : targets)
+	{
+		if (skin_mode == Mode::Compute)
+			runCompute(target);
+		else
+			runCpu(target, stage);
+
+		for (auto& m : target.model->meshes)
+		{
+			vertices += m.vertexCount;
+			indices += m.indexCount;
+		}
+	}
+	// every later pass reads the results as vertex attributes
+	if (skin_mode == Mode::Compute && !targets.empty())
+		glMemoryBarrier(GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
+}
+
+SkinningPass::Program& SkinningPass::programFor(bool compactVertices)
+{
+	Program& program = compactVertices ? compact : full;
+	if (program.shader)
+		return program;
+
+	std::vector<std::string> defines;
+	if (compactVertices)
+		defines.push_back("COMPACT_VERTEX");
+	program.shader = Shader::compute("skin.comp", defines);
+	program.baseVertex = program.shader->getUniformLocation("baseVertex");
+	program.vertexCount = program.shader->getUniformLocation("vertexCount");
+	program.boneOffset = program.shader->getUniformLocation("boneOffset");
+	program.positionOffset = program.shader->getUniformLocation("positionOffset");
+	program.positionScale = program.shader->getUniformLocation("positionScale");
+	return program;
+}
+
+// the palette buffer is still bound at BONE_PALETTE_BUFFER_BINDING by
+// AnimationStage::upload
+void SkinningPass::runCompute(Target& target)
+{
+	const Model& model = *target.model;
+	Program& program = programFor(model.options.compactVertices);
+
+	program.shader->use();
+	program.shader->setInt(program.boneOffset, target.palette);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, SKIN_INPUT_BUFFER_BINDING, model.VBO);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, SKIN_OUTPUT_BUFFER_BINDING, target.buffer);
+	for (auto& m : model.meshes)
+	{
+		if (m.vertexCount == 0)
+			continue;
+		program.shader->setInt(program.baseVertex, (int)m.baseVertex);
+		program.shader->setInt(program.vertexCount, (int)m.vertexCount);
+		program.shader->setVec3(program.positionOffset, m.positionOffset);
+		program.shader->setVec3(program.positionScale, m.positionScale);
+		glDispatchCompute((m.vertexCount + SKIN_GROUP_SIZE - 1) / SKIN_GROUP_SIZE, 1, 1);
+	}
+}
+
+void SkinningPass::runCpu(Target& target, const AnimationStage& stage)
+{
+	const std::vector<Vertex>& bindPose = target.model->bind_pose;
+	const glm::mat4* palette = &stage.palettes()[target.palette];
+	SkinnedVertex* out = target.skinned.data();
+	ThreadPool::frame().parallelFor(bindPose.size(), SKIN_CPU_GRAIN, [&](size_t begin, size_t end) {
+		skinVertices(bindPose.data() + begin, end - begin, palette, out + begin);
+	});
+
+	uploadOrphaned(GL_ARRAY_BUFFER, target.buffer, target.capacity, target.skinned.data(),
+		target.skinned.size() * sizeof(SkinnedVertex));
+}
+
+SkinningPass::Mode SkinningPass::mode() const
+{
+	return skin_mode;
+}
+
+size_t SkinningPass::vertexCount() const
+{
+	return vertices;
+}
+
+size_t SkinningPass::indexCount() const
+{
+	return indices;
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <cstddef>
+#include <memory>
+#include <vector>
+#include "GLHandle.h"
+#include "Shader.h"
+#include "Mesh.h"
+#include "AnimationStage.h"
+
+class Model;
+
+constexpr unsigned int SKIN_INPUT_BUFFER_BINDING = 5;
+constexpr unsigned int SKIN_OUTPUT_BUFFER_BINDING = 6;
+
+// model space vertex written by the skinning pre-pass, std430 layout of
+// SkinnedVertex in skin.comp
+struct SkinnedVertex
+{
+	glm::vec4 position;
+	glm::vec4 normal;
+};
+
+// CPU path of skin.comp: blends the four bone matrices of every vertex
+// with SSE, palette is the model's first bone matrix. No GL calls.
+void skinVertices(const Vertex* vertices, size_t count, const glm::mat4* palette, SkinnedVertex* out);
+
+// Skins every registered character once per frame into its own vertex
+// buffer, which all later passes draw as static geometry (Model::
+// SubmitSkinned / DrawIndirectSkinned with a shader built without
+// COMPACT_VERTEX) instead of blending bones in every pass' mesh.vert.
+// Runs skin.comp per sub-mesh, or skinVertices on ThreadPool::frame() and
+// an upload when built for the CPU, which needs the model imported with
+// ModelOptions::cpuSkinning.
+class SkinningPass
+{
+public:
+	enum class Mode
+	{
+		Compute,
+		Cpu
+	};
+
+	explicit SkinningPass(Mode mode = Mode::Compute);
+
+	// a character of model using the AnimationStage palette at palette;
+	// returns the vertex array to draw its skinned vertices with, 0 if
+	// the model can't be skinned. The model has to outlive the pass.
+	unsigned int add(const Model& model, int palette);
+	// after AnimationStage::upload, context thread only
+	void run(const AnimationStage& stage);
+
+	Mode mode() const;
+	// per run: vertices skinned, and the vertex shader invocations that
+	// would blend bones each time a pass draws the characters
+	size_t vertexCount() const;
+	size_t indexCount() const;
+
+private:
+	struct Target
+	{
+		const Model* model;
+		int palette;
+		GLBuffer buffer;
+		size_t capacity;
+		GLVertexArray vao;
+		std::vector<SkinnedVertex> skinned;
+	};
+
+	// skin.comp for one vertex layout, built on first use
+	struct Program
+	{
+		std::unique_ptr<Shader> shader;
+		int baseVertex, vertexCount, boneOffset, positionOffset, positionScale;
+	};
+
+	Mode skin_mode;
+	Program full, compact;
+	std::vector<Target> targets;
+	size_t vertices = 0;
+	size_t indices = 0;
+
+	Program& programFor(bool compactVertices);
+	void runCompute(Target& target);
+	void runCpu(Target& target, const AnimationStage& stage);
+};
@@ -2,6 +2,9 @@
 #include <GLFW/glfw3.h>
 
 #include <iostream>
+#include <memory>
+#include <chrono>
+#include <cstring>
 #include <glm/matrix.hpp>
 #include <glm/glm.hpp>
 #include <glm/gtc/type_ptr.hpp>
@@ -10,6 +13,9 @@
 #include "Camera.h"
 #include "Light.h"
 #include "Model.h"
+#include "AnimationStage.h"
+#include "SkinningPass.h"
+#include "UniformBuffer.h"
 
 Camera camera(glm::vec3(0.0f, 0.0f, 3.0f));
 const unsigned int WIDTH = 800;
@@ -19,6 +25,17 @@ float lastFrame = 0.0f;
 float lastX = WIDTH / 2.0f;
 float lastY = HEIGHT / 2.0f;
 bool firstMouse = false;
+bool multiDraw = false;
+bool multiDrawKeyDown = false;
+bool crowd = false;
+bool crowdKeyDown = false;
+bool skinningPass = true;
+bool skinningKeyDown = false;
+const unsigned int CROWD_SIDE = 100;
+// distinct animated characters the instanced crowd cycles through
+const unsigned int CROWD_POSES = 256;
+const char* MIKU_PATH = "models/dancing-anime/source/Samba.fbx";
+const char* STORMTROOPER_PATH = "models/dancing-stormtrooper/source/silly_dancing.fbx";
 
 glm::vec3 lightPos;
 glm::vec3 lightColor;
@@ -27,10 +44,26 @@ void processInput(GLFWwindow* window);
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
 void mouse_callback(GLFWwindow* window, double xpos, double ypos);
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
+bool keyToggled(GLFWwindow* window, int key, bool& down);
+void runScene(GLFWwindow* window, bool compactVertices, bool cpuSkinning);
+void benchmarkMipmaps();
+void benchmarkAnimation();
+void benchmarkCrowd();
+void benchmarkSkinning();
+void drawPlaceholder(Shader& shader, int modelLocation, int colorLocation, unsigned int vao, const ModelHandle& handle, const glm::mat4& transform);
 unsigned int loadTexture(char const* path);
 
-int main()
+int main(int argc, char** argv)
 {
+	// headless, no window or context
+	if (argc > 1 && std::strcmp(argv[1], "--benchmark-animation") == 0)
+	{
+		benchmarkAnimation();
+		benchmarkCrowd();
+		benchmarkSkinning();
+		return 0;
+	}
+
 	glfwInit();
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 4);
@@ -60,13 +93,44 @@ int main()
 	glEnable(GL_DEPTH_TEST);
 	glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_HIDDEN);
 
+	if (argc > 1 && std::strcmp(argv[1], "--benchmark-mipmaps") == 0)
+		benchmarkMipmaps();
+	else
+	{
+		auto flag = [&](const char* name) {
+			for (int i = 1; i < argc; i++)
+				if (std::strcmp(argv[i], name) == 0)
+					return true;
+			return false;
+		};
+		runScene(window, flag("--compact-vertices"), flag("--cpu-skinning"));
+	}
+
+	glfwTerminate();
+	return 0;
+}
+
+// everything owning GL objects lives in here so it is released before
+// the context goes away in glfwTerminate
+void runScene(GLFWwindow* window, bool compactVertices, bool cpuSkinning)
+{
 	stbi_set_flip_vertically_on_load(true);
 
 	//Shader shader("shader.vert", "shader.frag");
 	Shader lightShader("light.vert", "light.frag");
-	Shader meshShader("mesh.vert", "mesh.frag");
-	Model miku("models/dancing-anime/source/Samba.fbx");
-	Model stormtrooper("models/dancing-stormtrooper/source/silly_dancing.fbx");
+	// every mesh shader has to match the models' vertex layout
+	std::vector<std::string> layoutDefines;
+	if (compactVertices)
+		layoutDefines.push_back("COMPACT_VERTEX");
+	Shader meshShader("mesh.vert", "mesh.frag", layoutDefines);
+	// imported in the background, a box stands in until they are uploaded
+	StagingRing staging;
+	ModelOptions modelOptions;
+	modelOptions.staging = &staging;
+	modelOptions.compactVertices = compactVertices;
+	modelOptions.cpuSkinning = cpuSkinning;
+	ModelHandle miku = Model::loadAsync(MIKU_PATH, modelOptions);
+	ModelHandle stormtrooper = Model::loadAsync(STORMTROOPER_PATH, modelOptions);
 	//Model backpack("/models/backpack/backpack.obj");
 
 	float vertices[] = {
@@ -202,6 +266,74 @@ int main()
 		}
 	};
 
+	UniformBuffer frameUBO(sizeof(FrameBlock), FRAME_BLOCK_BINDING);
+	UniformBuffer lightsUBO(sizeof(LightsBlock), LIGHTS_BLOCK_BINDING);
+	lightShader.bindUniformBlock("Frame", FRAME_BLOCK_BINDING);
+	meshShader.bindUniformBlock("Frame", FRAME_BLOCK_BINDING);
+	meshShader.bindUniformBlock("Lights", LIGHTS_BLOCK_BINDING);
+
+	// multi-draw path, toggled with M, needs gl_DrawIDARB
+	std::unique_ptr<Shader> meshIndirectShader;
+	if (GLAD_GL_ARB_shader_draw_parameters)
+	{
+		std::vector<std::string> defines = layoutDefines;
+		defines.push_back("MULTI_DRAW");
+		if (bindlessDraws())
+			defines.push_back("BINDLESS");
+		meshIndirectShader = std::make_unique<Shader>("mesh.vert", "mesh.frag", defines);
+		meshIndirectShader->bindUniformBlock("Frame", FRAME_BLOCK_BINDING);
+		meshIndirectShader->bindUniformBlock("Lights", LIGHTS_BLOCK_BINDING);
+	}
+
+	// the skinning pre-pass writes full precision vertices, with compact
+	// layouts they need their own shaders; toggled with K
+	Shader* skinnedShader = &meshShader;
+	Shader* skinnedIndirectShader = meshIndirectShader.get();
+	std::unique_ptr<Shader> fullMeshShader, fullMeshIndirectShader;
+	if (compactVertices)
+	{
+		fullMeshShader = std::make_unique<Shader>("mesh.vert", "mesh.frag");
+		fullMeshShader->bindUniformBlock("Frame", FRAME_BLOCK_BINDING);
+		fullMeshShader->bindUniformBlock("Lights", LIGHTS_BLOCK_BINDING);
+		skinnedShader = fullMeshShader.get();
+		if (meshIndirectShader)
+		{
+			std::vector<std::string> defines = { "MULTI_DRAW" };
+			if (bindlessDraws())
+				defines.push_back("BINDLESS");
+			fullMeshIndirectShader = std::make_unique<Shader>("mesh.vert", "mesh.frag", defines);
+			fullMeshIndirectShader->bindUniformBlock("Frame", FRAME_BLOCK_BINDING);
+			fullMeshIndirectShader->bindUniformBlock("Lights", LIGHTS_BLOCK_BINDING);
+			skinnedIndirectShader = fullMeshIndirectShader.get();
+		}
+	}
+	SkinningPass skinning(cpuSkinning ? SkinningPass::Mode::Cpu : SkinningPass::Mode::Compute);
+	unsigned int mikuSkinned = 0, stormtrooperSkinned = 0;
+
+	// crowd of CROWD_SIDE^2 stormtroopers drawn instanced, toggled with I
+	std::vector<std::string> instancedDefines = layoutDefines;
+	instancedDefines.push_back("INSTANCED");
+	Shader meshInstancedShader("mesh.vert", "mesh.frag", instancedDefines);
+	meshInstancedShader.bindUniformBlock("Frame", FRAME_BLOCK_BINDING);
+	meshInstancedShader.bindUniformBlock("Lights", LIGHTS_BLOCK_BINDING);
+	std::vector<glm::mat4> crowdTransforms;
+	for (unsigned int x = 0; x < CROWD_SIDE; x++)
+		for (unsigned int z = 0; z < CROWD_SIDE; z++)
+		{
+			glm::mat4 transform = glm::translate(glm::mat4(1.0f), glm::vec3(x * 1.5f - CROWD_SIDE * 0.75f, -2.0f, -6.0f - z * 1.5f));
+			crowdTransforms.push_back(transform);
+		}
+
+	int lightModel = lightShader.getUniformLocation("model");
+	int lightColorLocation = lightShader.getUniformLocation("color");
+
+	RenderQueue queue;
+	float lastReport = 0.0f;
+	// characters join as their model finishes loading
+	AnimationStage animation;
+	int mikuPalette = -1, stormtrooperPalette = -1, crowdPalette = -1;
+	bool mikuStaged = false, stormtrooperStaged = false;
+
 	while (!glfwWindowShouldClose(window))
 	{
 		processInput(window);
@@ -216,49 +348,111 @@ int main()
 		glm::mat4 model = glm::mat4(1.0f);
 		view = camera.GetViewMatrix();
 
+		FrameBlock frame = { projection, view, glm::vec4(camera.Position, 1.0f) };
+		frameUBO.update(frame);
+		lightsUBO.update(makeLightsBlock(dirlight, pointlights, spotlight));
+
 		lightShader.use();
 		for (auto& s : pointlights) {
-			lightShader.setMat4("projection", projection);
-			lightShader.setMat4("view", view);
-
 			model = glm::mat4(1.0f);
-			lightShader.setVec3("color", s.color);
+			lightShader.setVec3(lightColorLocation, s.color);
 			model = glm::translate(model, s.position);
 			model = glm::scale(model, glm::vec3(0.2f));
-			lightShader.setMat4("model", model);
+			lightShader.setMat4(lightModel, model);
 
 			glBindVertexArray(lightVAO);
 			glDrawArrays(GL_TRIANGLES, 0, 36);
 		}
 
-		meshShader.use();
-		meshShader.setFloat("material.shininess", 64.0f);
-		meshShader.setDirectionalLight("dirlight", dirlight);
-
-		for (size_t i = 0; i < pointlights.size(); i++)
-		{
-			meshShader.setPointLight("pointlights[" + std::to_string(i) + "]", pointlights[i]);
-		}
-		meshShader.setSpotLight("spotlight", spotlight);
-
-		meshShader.setMat4("projection", projection);
-		meshShader.setMat4("view", view);
-		meshShader.setVec3("viewPos", camera.Position);
-		meshShader.setFloat("light.constant", 1.0f);
-		meshShader.setFloat("light.constant", 0.09f);
-		meshShader.setFloat("light.quadratic", 0.032f);
-		meshShader.setMat4("projection", projection);
-		meshShader.setMat4("view", view);
 		model = glm::mat4(1.0f);
 		model = glm::translate(model, glm::vec3(2.0f, -2.0f, -4.0f));
 		model = glm::scale(model, glm::vec3(2.0f));
-		meshShader.setMat4("model", model);
-		miku.Draw(meshShader);
+		glm::mat4 mikuModel = model;
 		model = glm::scale(model, glm::vec3(0.5f));
 		model = glm::translate(model, glm::vec3(-4.0f, 0.0f, 0.0f));
-		meshShader.setMat4("model", model);
-		stormtrooper.Draw(meshShader);
-		model = glm::translate(model, glm::vec3(-1.0f, 2.0f, 0.0f));
+		glm::mat4 stormtrooperModel = model;
+
+		miku.poll();
+		stormtrooper.poll();
+		staging.fence();
+		if (miku.ready() && !mikuStaged)
+		{
+			mikuPalette = animation.add(miku->clipSet());
+			mikuSkinned = skinning.add(*miku, mikuPalette);
+			mikuStaged = true;
+		}
+		if (stormtrooper.ready() && !stormtrooperStaged)
+		{
+			stormtrooperPalette = animation.add(stormtrooper->clipSet());
+			stormtrooperSkinned = skinning.add(*stormtrooper, stormtrooperPalette);
+			for (unsigned int i = 0; i < CROWD_POSES; i++)
+			{
+				int palette = animation.add(stormtrooper->clipSet(), 0, i * 0.37f);
+				if (i == 0)
+					crowdPalette = palette;
+			}
+			stormtrooperStaged = true;
+		}
+		animation.update(lastFrame);
+		animation.upload();
+		if (skinningPass)
+			skinning.run(animation);
+		bool mikuPrepass = skinningPass && mikuSkinned;
+		bool stormtrooperPrepass = skinningPass && stormtrooperSkinned;
+		if (!miku.ready())
+			drawPlaceholder(lightShader, lightModel, lightColorLocation, lightVAO, miku, mikuModel);
+		if (!stormtrooper.ready())
+			drawPlaceholder(lightShader, lightModel, lightColorLocation, lightVAO, stormtrooper, stormtrooperModel);
+
+		unsigned int draws = 0;
+		if (multiDraw && meshIndirectShader)
+		{
+			if (mikuPrepass)
+				draws += miku->DrawIndirectSkinned(*skinnedIndirectShader, mikuModel, mikuSkinned);
+			else if (miku.ready())
+				draws += miku->DrawIndirect(*meshIndirectShader, mikuModel, mikuPalette);
+			if (stormtrooperPrepass)
+				draws += stormtrooper->DrawIndirectSkinned(*skinnedIndirectShader, stormtrooperModel, stormtrooperSkinned);
+			else if (stormtrooper.ready())
+				draws += stormtrooper->DrawIndirect(*meshIndirectShader, stormtrooperModel, stormtrooperPalette);
+		}
+		else
+		{
+			if (mikuPrepass)
+				miku->SubmitSkinned(queue, *skinnedShader, mikuModel, mikuSkinned);
+			else if (miku.ready())
+				miku->Submit(queue, meshShader, mikuModel, mikuPalette);
+			if (stormtrooperPrepass)
+				stormtrooper->SubmitSkinned(queue, *skinnedShader, stormtrooperModel, stormtrooperSkinned);
+			else if (stormtrooper.ready())
+				stormtrooper->Submit(queue, meshShader, stormtrooperModel, stormtrooperPalette);
+			queue.flush();
+			draws += queue.drawCount();
+		}
+
+		if (crowd && stormtrooper.ready())
+			draws += stormtrooper->DrawInstanced(meshInstancedShader, crowdTransforms, crowdPalette, CROWD_POSES);
+
+		unsigned int lookups = Shader::resetLookupCount();
+		StateCache& state = queue.state();
+		if (lastFrame - lastReport >= 1.0f)
+		{
+			std::cout << "uniform lookups/frame: " << lookups
+				<< ", draws: " << draws
+				<< ", state changes issued: " << state.issuedCount()
+				<< ", skipped: " << state.skippedCount() << std::endl;
+			if (skinningPass && skinning.vertexCount())
+				std::cout << "skinning pre-pass (" << (skinning.mode() == SkinningPass::Mode::Cpu ? "cpu" : "compute") << "): "
+					<< skinning.vertexCount() << " vertices skinned per frame, up to " << skinning.indexCount()
+					<< " skinned vertex shader invocations per pass drawn as static instead" << std::endl;
+			if (staging.bytesUploaded())
+				std::cout << "staging: " << staging.bytesUploaded() / (1024.0 * 1024.0) / (lastFrame - lastReport)
+					<< " MB/s uploaded, " << staging.stallCount() << " stalls, "
+					<< staging.stallMilliseconds() << " ms stalled" << std::endl;
+			staging.resetStats();
+			lastReport = lastFrame;
+		}
+		state.resetCounters();
 
 		glfwSwapBuffers(window);
 		glfwPollEvents();
@@ -268,8 +462,188 @@ int main()
 	glDeleteVertexArrays(1, &lightVAO);
 	glDeleteBuffers(1, &VBO);
 
-	glfwTerminate();
-	return 0;
+	// an import still running holds its model, it must not be deleted
+	// after the context is gone
+	miku = ModelHandle();
+	stormtrooper = ModelHandle();
+	Model::deleteRetired(true);
+}
+
+// loads both models uncompressed with glGenerateMipmap and with CPU built
+// mip chains; the texture cache is empty for each run since the models of
+// the previous one are gone
+void benchmarkMipmaps()
+{
+	stbi_set_flip_vertically_on_load(true);
+
+	auto load = [](bool cpuMipmaps) {
+		ModelOptions options;
+		options.compressTextures = false;
+		options.cpuMipmaps = cpuMipmaps;
+		auto begin = std::chrono::steady_clock::now();
+		{
+			Model miku(MIKU_PATH, options);
+			Model stormtrooper(STORMTROOPER_PATH, options);
+			glFinish();
+		}
+		return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+	};
+
+	// warm up the file cache and the model bakes
+	load(false);
+	double gpu = load(false);
+	double cpu = load(true);
+	std::cout << "startup with glGenerateMipmap: " << gpu << " ms, with CPU mip chains: " << cpu << " ms" << std::endl;
+}
+
+// samples both clips for a crowd of characters at staggered times over a
+// few seconds of 60 Hz frames on one thread, with the scalar reference
+// sampler and the SIMD one, and reports the cost per character per frame
+// and bones per second
+void benchmarkAnimation()
+{
+	const unsigned int FRAMES = 600;
+	const unsigned int CHARACTERS = 100;
+	ModelOptions options;
+	options.loadTextures = false;
+	// the scalar sampler plays the clips as imported
+	options.keepRawAnimation = true;
+
+	for (const char* path : { MIKU_PATH, STORMTROOPER_PATH })
+	{
+		std::unique_ptr<Model> model = Model::importOnly(path, options);
+		if (!model || model->clips().empty())
+			continue;
+
+		std::vector<AnimationSampler> scalar(CHARACTERS, AnimationSampler(model->skeleton(), model->skinBones(), model->clips()));
+		std::vector<SimdSampler> simd(CHARACTERS, SimdSampler(model->clipSet()));
+
+		auto run = [&](auto& samplers) {
+			auto begin = std::chrono::steady_clock::now();
+			for (unsigned int frame = 0; frame < FRAMES; frame++)
+				for (unsigned int c = 0; c < CHARACTERS; c++)
+					samplers[c].evaluate(0, frame / 60.0f + c * 0.37f);
+			return std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+		};
+		double evaluations = (double)FRAMES * CHARACTERS;
+		double bones = evaluations * model->boneCount();
+		double scalarSeconds = run(scalar);
+		double simdSeconds = run(simd);
+
+		std::cout << path << ": " << model->boneCount() << " bones, " << SAMPLER_LANES << " lanes" << std::endl
+			<< "  scalar: " << scalarSeconds * 1e6 / evaluations << " us per character per frame, "
+			<< bones / scalarSeconds / 1e6 << " M bones/s per core" << std::endl
+			<< "  simd:   " << simdSeconds * 1e6 / evaluations << " us per character per frame, "
+			<< bones / simdSeconds / 1e6 << " M bones/s per core" << std::endl;
+	}
+}
+
+// updates an AnimationStage of a thousand stormtroopers with 1, 2, 4, ...
+// threads up to the hardware threads, and reports frame time and speedup
+// over one thread
+void benchmarkCrowd()
+{
+	const unsigned int FRAMES = 120;
+	const unsigned int CHARACTERS = 1000;
+	ModelOptions options;
+	options.loadTextures = false;
+
+	std::unique_ptr<Model> model = Model::importOnly(STORMTROOPER_PATH, options);
+	if (!model)
+		return;
+	AnimationStage stage;
+	for (unsigned int c = 0; c < CHARACTERS; c++)
+		stage.add(model->clipSet(), 0, c * 0.37f);
+	if (stage.characterCount() == 0)
+		return;
+
+	unsigned int hardware = std::max(1u, std::thread::hardware_concurrency());
+	std::vector<unsigned int> threadCounts;
+	for (unsigned int threads = 1; threads < hardware; threads *= 2)
+		threadCounts.push_back(threads);
+	threadCounts.push_back(hardware);
+
+	std::cout << "crowd of " << CHARACTERS << " characters, " << stage.matrixCount() << " palette matrices" << std::endl;
+	double single = 0.0;
+	for (unsigned int threads : threadCounts)
+	{
+		// the frame thread is one of them
+		std::unique_ptr<ThreadPool> pool = threads > 1 ? std::make_unique<ThreadPool>(threads - 1) : nullptr;
+		stage.update(0.0f, pool.get());
+		auto begin = std::chrono::steady_clock::now();
+		for (unsigned int frame = 0; frame < FRAMES; frame++)
+			stage.update(frame / 60.0f, pool.get());
+		double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count() / FRAMES;
+		if (threads == 1)
+			single = milliseconds;
+
+		std::cout << "  " << threads << " threads: " << milliseconds << " ms per frame, speedup "
+			<< single / milliseconds << "x (" << 100.0 * single / milliseconds / threads << "% of linear)" << std::endl;
+	}
+}
+
+// skins the stormtrooper with the CPU path of the skinning pre-pass, on
+// one thread and on the frame pool, and reports vertices per second
+void benchmarkSkinning()
+{
+	const unsigned int FRAMES = 120;
+	ModelOptions options;
+	options.loadTextures = false;
+	options.cpuSkinning = true;
+
+	std::unique_ptr<Model> model = Model::importOnly(STORMTROOPER_PATH, options);
+	if (!model)
+		return;
+	AnimationStage stage;
+	int palette = stage.add(model->clipSet());
+	if (palette < 0)
+		return;
+
+	const std::vector<Vertex>& bindPose = model->bindPose();
+	std::vector<SkinnedVertex> skinned(bindPose.size());
+	auto run = [&](ThreadPool* pool) {
+		auto begin = std::chrono::steady_clock::now();
+		for (unsigned int frame = 0; frame < FRAMES; frame++)
+		{
+			stage.update(frame / 60.0f, nullptr);
+			const glm::mat4* bones = &stage.palettes()[palette];
+			auto skin = [&](size_t first, size_t last) {
+				skinVertices(bindPose.data() + first, last - first, bones, skinned.data() + first);
+			};
+			if (pool)
+				pool->parallelFor(bindPose.size(), 1024, skin);
+			else
+				skin(0, bindPose.size());
+		}
+		return std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+	};
+	double single = run(nullptr);
+	double pooled = run(&ThreadPool::frame());
+	double vertices = (double)bindPose.size() * FRAMES;
+
+	std::cout << STORMTROOPER_PATH << ": cpu skinning " << bindPose.size() << " vertices, "
+		<< vertices / single / 1e6 << " M vertices/s on one thread, "
+		<< vertices / pooled / 1e6 << " M vertices/s on " << ThreadPool::frame().size() + 1 << " threads" << std::endl;
+}
+
+// unit cube scaled to the model's bounds, or just a unit cube while the
+// bounds aren't known yet
+void drawPlaceholder(Shader& shader, int modelLocation, int colorLocation, unsigned int vao, const ModelHandle& handle, const glm::mat4& transform)
+{
+	const Bounds& bounds = handle.bounds();
+	glm::vec3 size = bounds.max - bounds.min;
+	glm::mat4 model = transform;
+	if (size != glm::vec3(0.0f))
+	{
+		model = glm::translate(model, (bounds.min + bounds.max) * 0.5f);
+		model = glm::scale(model, size);
+	}
+
+	shader.use();
+	shader.setVec3(colorLocation, glm::vec3(0.4f));
+	shader.setMat4(modelLocation, model);
+	glBindVertexArray(vao);
+	glDrawArrays(GL_TRIANGLES, 0, 36);
 }
 
 void processInput(GLFWwindow* window)
@@ -292,6 +666,30 @@ void processInput(GLFWwindow* window)
 		camera.ProcessKeyboard(Camera_Movement::UP, deltaTime);
 	if (glfwGetKey(window, GLFW_KEY_X) == GLFW_PRESS)
 		camera.ProcessKeyboard(Camera_Movement::DOWN, deltaTime);
+
+	if (keyToggled(window, GLFW_KEY_M, multiDrawKeyDown))
+	{
+		multiDraw = !multiDraw;
+		std::cout << "multi-draw indirect " << (multiDraw ? "on" : "off") << std::endl;
+	}
+	if (keyToggled(window, GLFW_KEY_I, crowdKeyDown))
+	{
+		crowd = !crowd;
+		std::cout << "instanced crowd " << (crowd ? "on" : "off") << std::endl;
+	}
+	if (keyToggled(window, GLFW_KEY_K, skinningKeyDown))
+	{
+		skinningPass = !skinningPass;
+		std::cout << "skinning pre-pass " << (skinningPass ? "on" : "off") << std::endl;
+	}
+}
+
+bool keyToggled(GLFWwindow* window, int key, bool& down)
+{
+	bool pressed = glfwGetKey(window, key) == GLFW_PRESS;
+	bool toggled = pressed && !down;
+	down = pressed;
+	return toggled;
 }
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height)
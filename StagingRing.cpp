@@ -0,0 +1,167 @@
+#include "StagingRing.h"
+#include <chrono>
+#include <cstring>
+#include <algorithm>
+
+StagingRing::StagingRing(size_t capacity)
+	:size(capacity)
+{
+	const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+	ring = GLBuffer::create();
+	glBindBuffer(GL_COPY_READ_BUFFER, ring);
+	glBufferStorage(GL_COPY_READ_BUFFER, size, nullptr, flags);
+	mapped = static_cast<unsigned char*>(glMapBufferRange(GL_COPY_READ_BUFFER, 0, size, flags));
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
+}
+
+StagingRing::~StagingRing()
+{
+	for (auto& region : regions)
+		glDeleteSync(region.sync);
+	if (mapped)
+	{
+		glBindBuffer(GL_COPY_READ_BUFFER, ring);
+		glUnmapBuffer(GL_COPY_READ_BUFFER);
+		glBindBuffer(GL_COPY_READ_BUFFER, 0);
+	}
+}
+
+StagingRing::Allocation StagingRing::allocate(size_t bytes, size_t alignment)
+{
+	if (bytes > size || !mapped)
+		return {};
+
+	size_t offset = (head + alignment - 1) / alignment * alignment;
+	if (offset + bytes > size)
+	{
+		// fence what is written so far so regions never wrap around
+		fence();
+		offset = 0;
+		open = 0;
+	}
+
+	// the unfenced region is ours, only older regions can overlap
+	retire(offset, offset + bytes);
+
+	head = offset + bytes;
+	return { mapped + offset, offset, bytes };
+}
+
+void StagingRing::retire(size_t begin, size_t end)
+{
+	// after a wrap an older lap's region can sit in front of a newer one in
+	// the way, so find the newest overlapping region; fences signal in
+	// order, so everything queued before it is done once it is
+	size_t count = 0;
+	for (size_t i = 0; i < regions.size(); i++)
+		if (regions[i].begin < end && begin < regions[i].end)
+			count = i + 1;
+	if (count == 0)
+		return;
+
+	GLsync sync = regions[count - 1].sync;
+	GLenum status = glClientWaitSync(sync, 0, 0);
+	if (status == GL_TIMEOUT_EXPIRED)
+	{
+		auto start = std::chrono::steady_clock::now();
+		do
+			status = glClientWaitSync(sync, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+		while (status == GL_TIMEOUT_EXPIRED);
+		stalled += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		stalls++;
+	}
+	for (size_t i = 0; i < count; i++)
+	{
+		glDeleteSync(regions.front().sync);
+		regions.pop_front();
+	}
+}
+
+void StagingRing::copyToBuffer(const Allocation& allocation, unsigned int buffer, size_t offset)
+{
+	glBindBuffer(GL_COPY_READ_BUFFER, ring);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+	glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, allocation.offset, offset, allocation.size);
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	uploaded += allocation.size;
+}
+
+void StagingRing::copyToTexture(const Allocation& allocation, unsigned int texture, int level, int width, int height, GLenum format, GLenum type)
+{
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, ring);
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glTexSubImage2D(GL_TEXTURE_2D, level, 0, 0, width, height, format, type, (void*)allocation.offset);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	uploaded += allocation.size;
+}
+
+void StagingRing::copyToCompressedTexture(const Allocation& allocation, unsigned int texture, int level, int width, int height, GLenum format)
+{
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, ring);
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glCompressedTexSubImage2D(GL_TEXTURE_2D, level, 0, 0, width, height, format, (GLsizei)allocation.size, (void*)allocation.offset);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	uploaded += allocation.size;
+}
+
+void StagingRing::uploadBuffer(unsigned int buffer, size_t offset, const void* data, size_t bytes)
+{
+	const size_t chunk = size / 4;
+	const unsigned char* source = static_cast<const unsigned char*>(data);
+	for (size_t done = 0; done < bytes; done += chunk)
+	{
+		size_t count = std::min(chunk, bytes - done);
+		Allocation allocation = allocate(count);
+		if (!allocation.data)
+		{
+			glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+			glBufferSubData(GL_COPY_WRITE_BUFFER, offset + done, count, source + done);
+			glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+			continue;
+		}
+		std::memcpy(allocation.data, source + done, count);
+		copyToBuffer(allocation, buffer, offset + done);
+	}
+}
+
+void StagingRing::uploadTexture(unsigned int texture, int level, int width, int height, GLenum format, GLenum type, const void* data, size_t bytes)
+{
+	Allocation allocation = allocate(bytes);
+	if (!allocation.data)
+	{
+		glBindTexture(GL_TEXTURE_2D, texture);
+		glTexSubImage2D(GL_TEXTURE_2D, level, 0, 0, width, height, format, type, data);
+		return;
+	}
+	std::memcpy(allocation.data, data, bytes);
+	copyToTexture(allocation, texture, level, width, height, format, type);
+}
+
+void StagingRing::uploadCompressedTexture(unsigned int texture, int level, int width, int height, GLenum format, const void* data, size_t bytes)
+{
+	Allocation allocation = allocate(bytes);
+	if (!allocation.data)
+	{
+		glBindTexture(GL_TEXTURE_2D, texture);
+		glCompressedTexSubImage2D(GL_TEXTURE_2D, level, 0, 0, width, height, format, (GLsizei)bytes, data);
+		return;
+	}
+	std::memcpy(allocation.data, data, bytes);
+	copyToCompressedTexture(allocation, texture, level, width, height, format);
+}
+
+void StagingRing::fence()
+{
+	if (head == open)
+		return;
+	regions.push_back({ open, head, glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0) });
+	open = head;
+}
+
+void StagingRing::resetStats()
+{
+	uploaded = 0;
+	stalled = 0.0;
+	stalls = 0;
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <glad/glad.h>
+#include "GLHandle.h"
+#include <deque>
+#include <cstddef>
+
+// Persistently mapped upload buffer used as a ring. Space is handed out in
+// order and reclaimed once the fence covering the commands that read it has
+// signalled, so uploads never allocate storage or wait for the whole GPU.
+// allocate() and the copy calls need the context thread; the returned
+// pointer may be filled from any thread before the copy is issued.
+class StagingRing
+{
+public:
+	struct Allocation
+	{
+		unsigned char* data = nullptr;
+		size_t offset = 0;
+		size_t size = 0;
+	};
+
+	explicit StagingRing(size_t capacity = 32 * 1024 * 1024);
+	StagingRing(const StagingRing&) = delete;
+	StagingRing& operator=(const StagingRing&) = delete;
+	~StagingRing();
+
+	// blocks on older fences if the ring is full, data is null if size
+	// exceeds the capacity
+	Allocation allocate(size_t size, size_t alignment = 16);
+	void copyToBuffer(const Allocation& allocation, unsigned int buffer, size_t offset);
+	// the texture levels must already have storage
+	void copyToTexture(const Allocation& allocation, unsigned int texture, int level, int width, int height, GLenum format, GLenum type);
+	void copyToCompressedTexture(const Allocation& allocation, unsigned int texture, int level, int width, int height, GLenum format);
+
+	// allocate + memcpy + copy, split into chunks when larger than the ring
+	void uploadBuffer(unsigned int buffer, size_t offset, const void* data, size_t size);
+	// falls back to a direct glTexSubImage2D when the image doesn't fit
+	void uploadTexture(unsigned int texture, int level, int width, int height, GLenum format, GLenum type, const void* data, size_t size);
+	void uploadCompressedTexture(unsigned int texture, int level, int width, int height, GLenum format, const void* data, size_t size);
+
+	// closes the region written since the last fence, call after the copies
+	// of a batch (once a frame at least)
+	void fence();
+
+	size_t capacity() const { return size; }
+	size_t bytesUploaded() const { return uploaded; }
+	// time spent waiting for the GPU to release ring space
+	double stallMilliseconds() const { return stalled; }
+	unsigned int stallCount() const { return stalls; }
+	void resetStats();
+
+private:
+	struct Region
+	{
+		size_t begin;
+		size_t end;
+		GLsync sync;
+	};
+
+	GLBuffer ring;
+	unsigned char* mapped = nullptr;
+	size_t size;
+	size_t head = 0;
+	// start of the region not covered by a fence yet
+	size_t open = 0;
+	std::deque<Region> regions;
+
+	size_t uploaded = 0;
+	double stalled = 0.0;
+	unsigned int stalls = 0;
+
+	void retire(size_t begin, size_t end);
+};
@@ -0,0 +1,134 @@
+#include "TextureCache.h"
+#include "MappedFile.h"
+#include "Hash.h"
+#include "DDS.h"
+#include <filesystem>
+#include <sstream>
+#include <iomanip>
+
+DecodedTexture decodeTextureFile(const std::string& filename, const TextureDecodeOptions& options)
+{
+	MappedFile file(filename);
+	if (!file.isOpen())
+		return {};
+	return decodeTextureMemory(file.data(), file.size(), options);
+}
+
+DecodedTexture decodeTextureMemory(const unsigned char* data, size_t size, const TextureDecodeOptions& options)
+{
+	DecodedTexture decoded;
+	// the same image filtered as colour or as data, transcoded or not and
+	// with mips from either side makes different textures
+	unsigned char flags = (options.compress ? 1 : 0) | (options.cpuMipmaps ? 2 : 0) | (options.srgb ? 4 : 0);
+	decoded.key = fnv1a(&flags, sizeof(flags), fnv1a(data, size));
+	decoded.texture = TextureCache::shared().acquire(decoded.key);
+	if (decoded.texture)
+		return decoded;
+	if (!options.compress)
+	{
+		decoded.image = decodeImageMemory(data, size);
+		if (options.cpuMipmaps && decoded.image.pixels)
+		{
+			decoded.mips = buildMipChain(decoded.image, options.srgb);
+			decoded.image = Image();
+		}
+		return decoded;
+	}
+
+	std::ostringstream name;
+	name << TEXTURE_CACHE_DIR << '/' << std::hex << std::setw(16) << std::setfill('0') << decoded.key << ".dds";
+	if (readDDS(name.str(), decoded.compressed))
+		return decoded;
+
+	decoded.image = decodeImageMemory(data, size);
+	decoded.compressed = compressImage(buildMipChain(decoded.image, options.srgb));
+	if (decoded.compressed.format)
+	{
+		std::error_code error;
+		std::filesystem::create_directories(TEXTURE_CACHE_DIR, error);
+		writeDDS(name.str(), decoded.compressed);
+		decoded.image = Image();
+	}
+	return decoded;
+}
+
+TextureCache& TextureCache::shared()
+{
+	static TextureCache cache;
+	return cache;
+}
+
+unsigned int TextureCache::acquire(uint64_t key)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	auto entry = entries.find(key);
+	if (entry == entries.end())
+	{
+		missCount++;
+		return 0;
+	}
+	hitCount++;
+	saved += entry->second.bytes;
+	entry->second.references++;
+	return entry->second.texture;
+}
+
+unsigned int TextureCache::insert(uint64_t key, GLTexture texture, size_t bytes)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	Entry& entry = entries[key];
+	entry.texture = std::move(texture);
+	entry.handle = 0;
+	if (bindlessDraws())
+	{
+		entry.handle = glGetTextureHandleARB(entry.texture);
+		glMakeTextureHandleResidentARB(entry.handle);
+	}
+	entry.bytes = bytes;
+	entry.references = 1;
+	return entry.texture;
+}
+
+void TextureCache::release(uint64_t key)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	auto entry = entries.find(key);
+	if (entry != entries.end() && --entry->second.references == 0)
+	{
+		if (entry->second.handle)
+			glMakeTextureHandleNonResidentARB(entry->second.handle);
+		entries.erase(entry);
+	}
+}
+
+uint64_t TextureCache::handle(uint64_t key) const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	auto entry = entries.find(key);
+	return entry == entries.end() ? 0 : entry->second.handle;
+}
+
+size_t TextureCache::bytes(uint64_t key) const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	auto entry = entries.find(key);
+	return entry == entries.end() ? 0 : entry->second.bytes;
+}
+
+unsigned int TextureCache::hits() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return hitCount;
+}
+
+unsigned int TextureCache::misses() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return missCount;
+}
+
+size_t TextureCache::bytesSaved() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return saved;
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include "GLHandle.h"
+#include "Image.h"
+#include "BlockCompression.h"
+#include <unordered_map>
+#include <mutex>
+#include <cstdint>
+
+// BINDLESS shaders sample with the handles in materials[DrawID], which is
+// not dynamically uniform in the fragment shader; only NV_gpu_shader5
+// allows that, without it MULTI_DRAW binds the textures of each batch
+inline bool bindlessDraws()
+{
+	return GLAD_GL_ARB_bindless_texture && GLAD_GL_NV_gpu_shader5;
+}
+
+// BCn transcodes of decoded images, named by content hash
+constexpr auto TEXTURE_CACHE_DIR = "cache/textures";
+
+struct TextureDecodeOptions
+{
+	// BCn transcode, read from TEXTURE_CACHE_DIR or made and written there
+	bool compress = false;
+	// build the mips on the CPU instead of glGenerateMipmap
+	bool cpuMipmaps = true;
+	// colour data, mips are filtered in linear space
+	bool srgb = false;
+};
+
+// Result of a decode job: the content hash of the encoded image and the
+// pixels, their mip chain or their BCn transcode, whichever the options
+// asked for. All are skipped when the cache already holds the texture,
+// which is then acquired on the worker so it can't be released before
+// the caller uploads; the caller owns that reference.
+struct DecodedTexture
+{
+	uint64_t key = 0;
+	unsigned int texture = 0;
+	Image image;
+	MipChain mips;
+	CompressedImage compressed;
+};
+
+// Hashes and decodes an image file or an in-memory encoded image. Runs on
+// any thread; key is 0 if the file can't be read.
+DecodedTexture decodeTextureFile(const std::string& filename, const TextureDecodeOptions& options);
+DecodedTexture decodeTextureMemory(const unsigned char* data, size_t size, const TextureDecodeOptions& options);
+
+// Process-wide GL textures keyed by the content hash of the encoded image
+// and the decode options, shared by every Model and reference counted.
+// acquire() can be called from any thread, everything else needs the
+// context thread.
+class TextureCache
+{
+public:
+	static TextureCache& shared();
+
+	// adds a reference and returns the texture, 0 if it isn't cached
+	unsigned int acquire(uint64_t key);
+	// takes ownership with one reference held by the caller, the texture
+	// must be complete since it is made resident
+	unsigned int insert(uint64_t key, GLTexture texture, size_t bytes);
+	// the texture is deleted with its last reference
+	void release(uint64_t key);
+	// resident bindless handle, 0 unless bindlessDraws()
+	uint64_t handle(uint64_t key) const;
+	// texel bytes of the texture with its mips, 0 if it isn't cached
+	size_t bytes(uint64_t key) const;
+
+	unsigned int hits() const;
+	unsigned int misses() const;
+	// texel bytes not uploaded again thanks to hits
+	size_t bytesSaved() const;
+
+private:
+	struct Entry
+	{
+		GLTexture texture;
+		uint64_t handle;
+		size_t bytes;
+		unsigned int references;
+	};
+
+	mutable std::mutex mutex;
+	std::unordered_map<uint64_t, Entry> entries;
+	unsigned int hitCount = 0;
+	unsigned int missCount = 0;
+	size_t saved = 0;
+};
@@ -0,0 +1,176 @@
+#include "ThreadPool.h"
+#include <atomic>
+#include <cstdint>
+
+ThreadPool::ThreadPool(unsigned int threads)
+{
+	if (threads == 0)
+		threads = std::max(1u, std::thread::hardware_concurrency());
+	for (unsigned int i = 0; i < threads; i++)
+		workers.emplace_back(&ThreadPool::work, this);
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	wake.notify_all();
+	for (auto& worker : workers)
+		worker.join();
+}
+
+ThreadPool& ThreadPool::shared()
+{
+	static ThreadPool pool;
+	return pool;
+}
+
+ThreadPool& ThreadPool::frame()
+{
+	static ThreadPool pool(std::max(2u, std::thread::hardware_concurrency()) - 1);
+	return pool;
+}
+
+namespace {
+
+// [begin, end) packed into one word so taking from the front and stealing
+// from the back are single compare-exchanges
+struct alignas(64) StealRange
+{
+	std::atomic<uint64_t> bounds{ 0 };
+};
+
+uint64_t packRange(uint64_t begin, uint64_t end)
+{
+	return begin | end << 32;
+}
+
+bool takeFront(StealRange& range, size_t grain, size_t& begin, size_t& end)
+{
+	uint64_t current = range.bounds.load();
+	while (true)
+	{
+		uint64_t first = current & 0xffffffff, last = current >> 32;
+		if (first >= last)
+			return false;
+		uint64_t next = std::min<uint64_t>(last, first + grain);
+		if (range.bounds.compare_exchange_weak(current, packRange(next, last)))
+		{
+			begin = (size_t)first;
+			end = (size_t)next;
+			return true;
+		}
+	}
+}
+
+// moves the back half of victim, or all of it when it's a single chunk,
+// into the thief's empty range
+bool stealBack(StealRange& victim, StealRange& thief, size_t grain)
+{
+	uint64_t current = victim.bounds.load();
+	while (true)
+	{
+		uint64_t first = current & 0xffffffff, last = current >> 32;
+		if (first >= last)
+			return false;
+		uint64_t middle = last - first <= grain ? first : first + (last - first) / 2;
+		if (victim.bounds.compare_exchange_weak(current, packRange(first, middle)))
+		{
+			thief.bounds.store(packRange(middle, last));
+			return true;
+		}
+	}
+}
+
+struct ParallelLoop
+{
+	std::function<void(size_t, size_t)> body;
+	size_t count;
+	size_t grain;
+	unsigned int parts;
+	std::unique_ptr<StealRange[]> ranges;
+	std::atomic<size_t> done{ 0 };
+	std::mutex mutex;
+	std::condition_variable finished;
+
+	void run(unsigned int part)
+	{
+		StealRange& own = ranges[part];
+		while (true)
+		{
+			size_t begin, end;
+			if (takeFront(own, grain, begin, end))
+			{
+				body(begin, end);
+				if (done.fetch_add(end - begin) + (end - begin) == count)
+				{
+					std::lock_guard<std::mutex> lock(mutex);
+					finished.notify_all();
+				}
+				continue;
+			}
+			bool stolen = false;
+			for (unsigned int k = 1; k < parts && !stolen; k++)
+				stolen = stealBack(ranges[(part + k) % parts], own, grain);
+			if (!stolen)
+				return;
+		}
+	}
+};
+
+}
+
+void ThreadPool::parallelFor(size_t count, size_t grain, const std::function<void(size_t, size_t)>& body)
+{
+	if (count == 0)
+		return;
+
+	// helpers may only get to run after the loop finished, they share its
+	// ownership and find nothing left to do
+	auto loop = std::make_shared<ParallelLoop>();
+	loop->body = body;
+	loop->count = count;
+	loop->grain = std::max<size_t>(grain, 1);
+	loop->parts = (unsigned int)std::min<size_t>(workers.size() + 1, (count + loop->grain - 1) / loop->grain);
+	loop->ranges.reset(new StealRange[loop->parts]);
+	for (unsigned int p = 0; p < loop->parts; p++)
+		loop->ranges[p].bounds.store(packRange(count * p / loop->parts, count * (p + 1) / loop->parts));
+
+	if (loop->parts > 1)
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			for (unsigned int p = 0; p + 1 < loop->parts; p++)
+				jobs.push([loop, p]() { loop->run(p); });
+		}
+		wake.notify_all();
+	}
+
+	loop->run(loop->parts - 1);
+	std::unique_lock<std::mutex> lock(loop->mutex);
+	loop->finished.wait(lock, [&]() { return loop->done.load() == count; });
+}
+
+unsigned int ThreadPool::size() const
+{
+	return (unsigned int)workers.size();
+}
+
+void ThreadPool::work()
+{
+	while (true)
+	{
+		std::function<void()> job;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			wake.wait(lock, [this]() { return stopping || !jobs.empty(); });
+			if (jobs.empty())
+				return;
+			job = std::move(jobs.front());
+			jobs.pop();
+		}
+		job();
+	}
+}
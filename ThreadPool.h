@@ -0,0 +1,64 @@
+#pragma once
+
+#include <vector>
+#include <queue>
+#include <thread>
+#include <algorithm>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <type_traits>
+#include <cstddef>
+
+// Fixed set of worker threads pulling jobs from one FIFO queue.
+class ThreadPool
+{
+public:
+	// 0 picks one worker per hardware thread
+	explicit ThreadPool(unsigned int threads = 0);
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+	// finishes the queued jobs before joining
+	~ThreadPool();
+
+	// pool used for loading work, created on first use
+	static ThreadPool& shared();
+	// pool for per-frame work like the animation update, kept free of long
+	// loading jobs; one worker less than hardware threads since the frame
+	// thread joins in
+	static ThreadPool& frame();
+
+	template<typename F>
+	auto submit(F&& job) -> std::future<std::invoke_result_t<std::decay_t<F>>>
+	{
+		using Result = std::invoke_result_t<std::decay_t<F>>;
+		auto task = std::make_shared<std::packaged_task<Result()>>(std::forward<F>(job));
+		std::future<Result> result = task->get_future();
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			jobs.push([task]() { (*task)(); });
+		}
+		wake.notify_one();
+		return result;
+	}
+
+	// Calls body(begin, end) over [0, count) in chunks of up to grain items
+	// and returns once all are done. Every worker and the calling thread
+	// start on their own slice and, when it runs dry, steal half of what is
+	// left of another, so uneven items still balance. The calling thread
+	// works too, so this finishes even while the workers are busy.
+	void parallelFor(size_t count, size_t grain, const std::function<void(size_t, size_t)>& body);
+
+	unsigned int size() const;
+
+private:
+	std::vector<std::thread> workers;
+	std::queue<std::function<void()>> jobs;
+	std::mutex mutex;
+	std::condition_variable wake;
+	bool stopping = false;
+
+	void work();
+};
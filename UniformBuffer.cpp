@@ -0,0 +1,66 @@
+#include "UniformBuffer.h"
+#include <algorithm>
+#include <iostream>
+
+UniformBuffer::UniformBuffer(GLsizeiptr size, unsigned int binding)
+{
+	glGenBuffers(1, &ID);
+	glBindBuffer(GL_UNIFORM_BUFFER, ID);
+	glBufferData(GL_UNIFORM_BUFFER, size, nullptr, GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	glBindBufferBase(GL_UNIFORM_BUFFER, binding, ID);
+}
+
+UniformBuffer::~UniformBuffer()
+{
+	glDeleteBuffers(1, &ID);
+}
+
+void UniformBuffer::update(const void* data, GLsizeiptr size, GLintptr offset)
+{
+	glBindBuffer(GL_UNIFORM_BUFFER, ID);
+	glBufferSubData(GL_UNIFORM_BUFFER, offset, size, data);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+LightsBlock makeLightsBlock(const Dirlight& dirlight, const std::vector<Pointlight>& pointlights, const Spotlight& spotlight)
+{
+	LightsBlock block = {};
+
+	block.dirlight.direction = dirlight.direction;
+	block.dirlight.ambient = dirlight.ambient;
+	block.dirlight.diffuse = dirlight.diffuse;
+	block.dirlight.specular = dirlight.specular;
+	block.dirlight.color = dirlight.color;
+
+	if (pointlights.size() > MAX_POINT_LIGHTS)
+		std::cout << "Only the first " << MAX_POINT_LIGHTS << " point lights are uploaded." << std::endl;
+	block.numPointlights = (int)std::min(pointlights.size(), (size_t)MAX_POINT_LIGHTS);
+	for (int i = 0; i < block.numPointlights; i++)
+	{
+		const Pointlight& light = pointlights[i];
+		PointlightStd140& out = block.pointlights[i];
+		out.position = light.position;
+		out.ambient = light.ambient;
+		out.diffuse = light.diffuse;
+		out.specular = light.specular;
+		out.color = light.color;
+		out.constant = light.constant;
+		out.linear = light.linear;
+		out.quadratic = light.quadratic;
+	}
+
+	block.spotlight.position = spotlight.position;
+	block.spotlight.direction = spotlight.direction;
+	block.spotlight.ambient = spotlight.ambient;
+	block.spotlight.diffuse = spotlight.diffuse;
+	block.spotlight.specular = spotlight.specular;
+	block.spotlight.color = spotlight.color;
+	block.spotlight.innerCutoff = spotlight.innerCutoff;
+	block.spotlight.outerCutoff = spotlight.outerCutoff;
+	block.spotlight.constant = spotlight.constant;
+	block.spotlight.linear = spotlight.linear;
+	block.spotlight.quadratic = spotlight.quadratic;
+
+	return block;
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <vector>
+
+#include "Light.h"
+
+constexpr unsigned int FRAME_BLOCK_BINDING = 0;
+constexpr unsigned int LIGHTS_BLOCK_BINDING = 1;
+constexpr auto MAX_POINT_LIGHTS = 4;
+
+// std140 mirrors of the blocks declared in the shaders, vec3 members are
+// padded to 16 bytes and trailing floats fill the padding like GLSL does
+
+struct FrameBlock {
+	glm::mat4 projection;
+	glm::mat4 view;
+	glm::vec4 viewPos;
+};
+
+struct DirlightStd140 {
+	glm::vec3 direction; float pad0;
+	glm::vec3 ambient; float pad1;
+	glm::vec3 diffuse; float pad2;
+	glm::vec3 specular; float pad3;
+	glm::vec3 color; float pad4;
+};
+
+struct PointlightStd140 {
+	glm::vec3 position; float pad0;
+	glm::vec3 ambient; float pad1;
+	glm::vec3 diffuse; float pad2;
+	glm::vec3 specular; float pad3;
+	glm::vec3 color; float constant;
+	float linear, quadratic, pad4[2];
+};
+
+struct SpotlightStd140 {
+	glm::vec3 position; float pad0;
+	glm::vec3 direction; float pad1;
+	glm::vec3 ambient; float pad2;
+	glm::vec3 diffuse; float pad3;
+	glm::vec3 specular; float pad4;
+	glm::vec3 color; float innerCutoff;
+	float outerCutoff, constant, linear, quadratic;
+};
+
+struct LightsBlock {
+	DirlightStd140 dirlight;
+	PointlightStd140 pointlights[MAX_POINT_LIGHTS];
+	SpotlightStd140 spotlight;
+	int numPointlights;
+	int pad[3];
+};
+
+static_assert(sizeof(FrameBlock) == 144, "FrameBlock must match the std140 Frame block");
+static_assert(sizeof(DirlightStd140) == 80, "DirlightStd140 must match std140 Dirlight");
+static_assert(sizeof(PointlightStd140) == 96, "PointlightStd140 must match std140 Pointlight");
+static_assert(sizeof(SpotlightStd140) == 112, "SpotlightStd140 must match std140 Spotlight");
+static_assert(sizeof(LightsBlock) == 592, "LightsBlock must match the std140 Lights block");
+
+LightsBlock makeLightsBlock(const Dirlight& dirlight, const std::vector<Pointlight>& pointlights, const Spotlight& spotlight);
+
+class UniformBuffer
+{
+public:
+	unsigned int ID;
+	UniformBuffer(GLsizeiptr size, unsigned int binding);
+	UniformBuffer(const UniformBuffer&) = delete;
+	UniformBuffer& operator=(const UniformBuffer&) = delete;
+	~UniformBuffer();
+	void update(const void* data, GLsizeiptr size, GLintptr offset = 0);
+
+	template<typename T>
+	void update(const T& block)
+	{
+		update(&block, sizeof(T));
+	}
+};
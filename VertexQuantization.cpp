@@ -0,0 +1,101 @@
+#include "VertexQuantization.h"
+#include <glm/gtc/packing.hpp>
+#include <algorithm>
+#include <cmath>
+
+constexpr float UNORM16_MAX = 65535.0f;
+constexpr float SNORM16_MAX = 32767.0f;
+
+static float signNotZero(float v)
+{
+	return v >= 0.0f ? 1.0f : -1.0f;
+}
+
+glm::vec2 octEncode(const glm::vec3& normal)
+{
+	float l1 = std::abs(normal.x) + std::abs(normal.y) + std::abs(normal.z);
+	if (l1 == 0.0f)
+		return glm::vec2(0.0f, 0.0f);
+	glm::vec3 n = normal / l1;
+	if (n.z >= 0.0f)
+		return glm::vec2(n.x, n.y);
+	// fold the lower hemisphere over the diagonals
+	return glm::vec2((1.0f - std::abs(n.y)) * signNotZero(n.x), (1.0f - std::abs(n.x)) * signNotZero(n.y));
+}
+
+// same as octDecode in mesh.vert
+glm::vec3 octDecode(const glm::vec2& encoded)
+{
+	glm::vec3 n(encoded.x, encoded.y, 1.0f - std::abs(encoded.x) - std::abs(encoded.y));
+	float t = std::max(-n.z, 0.0f);
+	n.x += n.x >= 0.0f ? -t : t;
+	n.y += n.y >= 0.0f ? -t : t;
+	return glm::normalize(n);
+}
+
+static int16_t toSnorm16(float v)
+{
+	return (int16_t)std::lround(std::clamp(v, -1.0f, 1.0f) * SNORM16_MAX);
+}
+
+static float fromSnorm16(int16_t v)
+{
+	return std::max(v / SNORM16_MAX, -1.0f);
+}
+
+QuantizationBounds quantizeVertices(const Vertex* vertices, size_t count, CompactVertex* out, QuantizationError& error)
+{
+	QuantizationBounds bounds;
+	if (count == 0)
+		return bounds;
+
+	glm::vec3 min = vertices[0].Position, max = vertices[0].Position;
+	for (size_t i = 1; i < count; i++)
+	{
+		min = glm::min(min, vertices[i].Position);
+		max = glm::max(max, vertices[i].Position);
+	}
+	bounds.offset = min;
+	bounds.scale = max - min;
+
+	for (size_t i = 0; i < count; i++)
+	{
+		const Vertex& v = vertices[i];
+		CompactVertex& c = out[i];
+
+		for (int axis = 0; axis < 3; axis++)
+		{
+			float extent = bounds.scale[axis];
+			float t = extent > 0.0f ? (v.Position[axis] - min[axis]) / extent : 0.0f;
+			c.position[axis] = (uint16_t)std::lround(std::clamp(t, 0.0f, 1.0f) * UNORM16_MAX);
+			float decoded = min[axis] + c.position[axis] / UNORM16_MAX * extent;
+			error.position = std::max(error.position, std::abs(decoded - v.Position[axis]));
+		}
+		c.position[3] = 0;
+
+		glm::vec2 oct = octEncode(v.Normal);
+		c.normal[0] = toSnorm16(oct.x);
+		c.normal[1] = toSnorm16(oct.y);
+		float length = glm::length(v.Normal);
+		if (length > 0.0f)
+		{
+			glm::vec3 decoded = octDecode(glm::vec2(fromSnorm16(c.normal[0]), fromSnorm16(c.normal[1])));
+			float cosine = std::clamp(glm::dot(decoded, v.Normal / length), -1.0f, 1.0f);
+			error.normalDegrees = std::max(error.normalDegrees, glm::degrees(std::acos(cosine)));
+		}
+
+		for (int axis = 0; axis < 2; axis++)
+		{
+			c.texCoords[axis] = glm::packHalf1x16(v.TexCoords[axis]);
+			error.texCoord = std::max(error.texCoord, std::abs(glm::unpackHalf1x16(c.texCoords[axis]) - v.TexCoords[axis]));
+		}
+
+		// mesh.vert renormalizes the weights
+		for (int k = 0; k < NUM_BONES_PER_VERTEX; k++)
+		{
+			c.boneIDs[k] = (uint8_t)v.BoneIDs[k];
+			c.weights[k] = (uint8_t)std::lround(std::clamp(v.Weights[k], 0.0f, 1.0f) * 255.0f);
+		}
+	}
+	return bounds;
+}
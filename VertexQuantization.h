@@ -0,0 +1,41 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <cstddef>
+#include "Mesh.h"
+
+// 24 byte vertex, read by mesh.vert built with COMPACT_VERTEX:
+// position as unorm16 inside the mesh's box (w is padding), normal
+// octahedral-encoded as snorm16, texture coordinates as half floats,
+// bone ids as bytes (MAX_BONES fits) and weights as unorm8.
+struct CompactVertex
+{
+	uint16_t position[4];
+	int16_t normal[2];
+	uint16_t texCoords[2];
+	uint8_t boneIDs[NUM_BONES_PER_VERTEX];
+	uint8_t weights[WEIGHTS_PER_VERTEX];
+};
+static_assert(sizeof(CompactVertex) == 24, "CompactVertex must stay 24 bytes");
+
+// position = offset + quantized * scale, per mesh
+struct QuantizationBounds
+{
+	glm::vec3 offset = glm::vec3(0.0f);
+	glm::vec3 scale = glm::vec3(1.0f);
+};
+
+// largest round-trip error over a range of vertices
+struct QuantizationError
+{
+	float position = 0.0f;
+	float normalDegrees = 0.0f;
+	float texCoord = 0.0f;
+};
+
+glm::vec2 octEncode(const glm::vec3& normal);
+glm::vec3 octDecode(const glm::vec2& encoded);
+
+// quantizes count vertices against their own bounding box, no GL calls
+QuantizationBounds quantizeVertices(const Vertex* vertices, size_t count, CompactVertex* out, QuantizationError& error);
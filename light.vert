@@ -1,8 +1,12 @@
 #version 330 core
 layout (location = 0) in vec3 aPos;
 
-uniform mat4 view;
-uniform mat4 projection;
+layout (std140) uniform Frame {
+	mat4 projection;
+	mat4 view;
+	vec3 viewPos;
+};
+
 uniform mat4 model;
 
 void main()
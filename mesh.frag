@@ -1,4 +1,10 @@
-#version 330 core
+#version 440 core
+#ifdef BINDLESS
+// the handles come from materials[DrawID], which isn't dynamically uniform
+// here; NV_gpu_shader5 allows sampling with them anyway, see bindlessDraws
+#extension GL_ARB_bindless_texture : require
+#extension GL_NV_gpu_shader5 : require
+#endif
 out vec4 FragColor;
 
 in vec2 TexCoords;
@@ -11,52 +17,89 @@ struct Material {
 	vec3 specular;
 	float shininess;
 };
+
+#ifdef MULTI_DRAW
+struct DrawMaterial {
+	vec4 ambient, diffuse, specular;
+	uvec2 diffuseMap, specularMap;
+	float shininess;
+	int textured;
+	int diffuseLayer, specularLayer;
+};
+layout (std430, binding = 2) readonly buffer Materials {
+	DrawMaterial materials[];
+};
+flat in int DrawID;
+Material material;
+bool textured;
+int diffuseLayer;
+#else
 uniform Material material;
+uniform bool textured;
+uniform int diffuseLayer;
+#endif
 
 struct Dirlight {
 	vec3 direction, ambient, diffuse, specular, color;
 };
-uniform Dirlight dirlight;
 
 struct Pointlight {
 	vec3 position, ambient, diffuse, specular, color;
 	float constant, linear, quadratic;
 };
-#define NR_POINT_LIGHTS 1
-uniform Pointlight pointlights[NR_POINT_LIGHTS];
 
 struct Spotlight {
 	vec3 position, direction, ambient, diffuse, specular,  color;
 	float innerCutoff, outerCutoff, constant, linear, quadratic;
 };
-uniform Spotlight spotlight;
 
-uniform vec3 viewPos;
+layout (std140) uniform Frame {
+	mat4 projection;
+	mat4 view;
+	vec3 viewPos;
+};
+
+#define MAX_POINT_LIGHTS 4
+layout (std140) uniform Lights {
+	Dirlight dirlight;
+	Pointlight pointlights[MAX_POINT_LIGHTS];
+	Spotlight spotlight;
+	int numPointlights;
+};
 
 vec3 calc_directional(Dirlight light, vec3 normal, vec3 viewDir);
 vec3 calc_point(Pointlight light, vec3 normal, vec3 fragPos, vec3 viewDir);
 vec3 calc_spot(Spotlight light, vec3 normal, vec3 fragPos, vec3 viewDir);
 
-uniform bool textured;
-
-uniform sampler2D texture_diffuse1;
-uniform sampler2D texture_specular1;
+// model textures are packed into arrays, the layer picks the texture
+uniform sampler2DArray texture_diffuse1;
+uniform sampler2DArray texture_specular1;
 
 
 void main()
 {    
+#ifdef MULTI_DRAW
+	DrawMaterial m = materials[DrawID];
+	material = Material(m.ambient.xyz, m.diffuse.xyz, m.specular.xyz, m.shininess);
+	textured = m.textured != 0;
+	diffuseLayer = m.diffuseLayer;
+#endif
 	vec3 norm = normalize(vec3(Normal));
 	vec3 viewDir = normalize(viewPos - FragPos);
 	//
 	vec3 result = calc_directional(dirlight, norm, viewDir);
 	//
-	for (int i=0; i<NR_POINT_LIGHTS; i++)
+	for (int i=0; i<numPointlights; i++)
 		result += calc_point(pointlights[i], norm, FragPos, viewDir);
 
 	result += calc_spot(spotlight, norm, FragPos, viewDir);
 
 	if (textured)
-		FragColor = texture(texture_diffuse1, TexCoords) * vec4(result, 1.0);
+#ifdef BINDLESS
+		FragColor = texture(sampler2DArray(m.diffuseMap), vec3(TexCoords, diffuseLayer)) * vec4(result, 1.0);
+#else
+		FragColor = texture(texture_diffuse1, vec3(TexCoords, diffuseLayer)) * vec4(result, 1.0);
+#endif
 	else
 		FragColor = vec4(result, 1.0);
 }
@@ -1,39 +1,117 @@
-#version 330 core
+#version 440 core
+#ifdef MULTI_DRAW
+#extension GL_ARB_shader_draw_parameters : require
+#endif
+#ifdef COMPACT_VERTEX
+// unorm16 inside the mesh's box and octahedral snorm16, see CompactVertex
+layout (location = 0) in vec4 aPos;
+layout (location = 1) in vec2 aNormal;
+#else
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aNormal;
+#endif
 layout (location = 2) in vec2 aTexCoords;
 layout (location = 3) in ivec4 BoneIDs;
 layout (location = 4) in vec4 Weights;
+#ifdef INSTANCED
+layout (location = 5) in mat4 instanceModel;
+#endif
 
 out vec2 TexCoords;
 out vec4 Normal;
 out vec3 FragPos;
+#ifdef MULTI_DRAW
+flat out int DrawID;
+#endif
 
-const int MAX_BONES = 100;
+layout (std140) uniform Frame {
+	mat4 projection;
+	mat4 view;
+	vec3 viewPos;
+};
 
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
-uniform mat4 bones[MAX_BONES];
 uniform bool animated;
+// first matrix of the draw's palette, instances cycle through paletteCount
+// consecutive palettes of boneStride matrices
+uniform int boneOffset;
+uniform int boneStride;
+uniform int paletteCount;
+
+layout (std430, binding = 4) readonly buffer BonePalettes {
+    mat4 palettes[];
+};
+#ifdef MULTI_DRAW
+uniform int drawOffset;
+#endif
+
+#ifdef COMPACT_VERTEX
+#ifdef MULTI_DRAW
+struct DrawQuantization {
+    vec4 offset;
+    vec4 scale;
+};
+
+layout (std430, binding = 3) readonly buffer Quantization {
+    DrawQuantization quantization[];
+};
+#else
+uniform vec3 positionOffset;
+uniform vec3 positionScale;
+#endif
+
+vec3 octDecode(vec2 e)
+{
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0);
+    n.xy += vec2(n.x >= 0.0 ? -t : t, n.y >= 0.0 ? -t : t);
+    return normalize(n);
+}
+#endif
 
 void main()
 {
+#ifdef COMPACT_VERTEX
+#ifdef MULTI_DRAW
+    DrawQuantization q = quantization[drawOffset + gl_DrawIDARB];
+    vec3 position = q.offset.xyz + aPos.xyz * q.scale.xyz;
+#else
+    vec3 position = positionOffset + aPos.xyz * positionScale;
+#endif
+    vec3 normal = octDecode(aNormal);
+#else
+    vec3 position = aPos;
+    vec3 normal = aNormal;
+#endif
+
+    // static meshes have no weights; unorm8 weights may not sum to exactly 1
+    float totalWeight = Weights[0] + Weights[1] + Weights[2] + Weights[3];
+    vec4 bone_pos = vec4(position, 1.0f);
+    if (animated && totalWeight > 0.0)
+    {
+        int base = boneOffset + (gl_InstanceID % max(paletteCount, 1)) * boneStride;
+        mat4 skin = palettes[base + BoneIDs[0]] * Weights[0];
+        skin += palettes[base + BoneIDs[1]] * Weights[1];
+        skin += palettes[base + BoneIDs[2]] * Weights[2];
+        skin += palettes[base + BoneIDs[3]] * Weights[3];
+        skin /= totalWeight;
+        bone_pos = skin * bone_pos;
+        normal = mat3(skin) * normal;
+    }
+
+#ifdef INSTANCED
+    mat4 world = instanceModel;
+#else
+    mat4 world = model;
+#endif
 
-    mat4 skin = bones[BoneIDs[0]] * Weights[0];
-    skin += bones[BoneIDs[1]] * Weights[1];
-    skin += bones[BoneIDs[2]] * Weights[2];
-    skin += bones[BoneIDs[3]] * Weights[3];
-    vec4 bone_pos;
-    if (animated)
-    bone_pos = skin * vec4(aPos, 1.0f);
-    else 
-    bone_pos = vec4(aPos, 1.0f);
-    
-    FragPos = vec3(model * bone_pos);
+    FragPos = vec3(world * bone_pos);
     TexCoords = aTexCoords;
-    vec3 n_matrix = mat3(transpose(inverse(model))) * aNormal;
+#ifdef MULTI_DRAW
+    DrawID = drawOffset + gl_DrawIDARB;
+#endif
+    vec3 n_matrix = mat3(transpose(inverse(world))) * normal;
     Normal = normalize(vec4(n_matrix, 0.0));
 
-    gl_Position = (projection * view * model) * bone_pos;
+    gl_Position = (projection * view * world) * bone_pos;
 }
\ No newline at end of file